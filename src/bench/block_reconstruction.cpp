@@ -0,0 +1,67 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <consensus/merkle.h>
+#include <random.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const size_t MEMPOOL_TXS = 100000;
+static const size_t BLOCK_TXS = 2500;
+
+static CTransactionRef MakeTx(FastRandomContext& rand)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(rand.rand256(), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = COIN;
+    return MakeTransactionRef(tx);
+}
+
+// Fill the short IDs of a compact block from a 100k transaction mempool. One
+// of the block's transactions is not in the mempool, so all of it is scanned,
+// as happens whenever we are missing any transaction.
+static void BlockReconstruction(benchmark::State& state)
+{
+    FastRandomContext rand(true);
+    CTxMemPool pool;
+    std::vector<CTransactionRef> txs;
+    LockPoints lp;
+    {
+        LOCK(pool.cs);
+        for (size_t i = 0; i < MEMPOOL_TXS; i++) {
+            txs.push_back(MakeTx(rand));
+            pool.addUnchecked(txs.back()->GetHash(), CTxMemPoolEntry(txs.back(), 1000, 0, 1, false, 4, lp));
+        }
+    }
+
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < BLOCK_TXS - 1; i++) {
+        block.vtx.push_back(txs[i * (MEMPOOL_TXS / BLOCK_TXS)]);
+    }
+    block.vtx.push_back(MakeTx(rand));
+    block.nBits = 0x207fffff;
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partial(&pool);
+        bool ret = partial.InitData(cmpctblock, extra_txn) == READ_STATUS_OK;
+        assert(ret);
+        assert(partial.IsTxAvailable(1) && !partial.IsTxAvailable(BLOCK_TXS));
+    }
+}
+
+BENCHMARK(BlockReconstruction, 200);
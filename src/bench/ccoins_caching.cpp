@@ -4,7 +4,9 @@
 
 #include <bench/bench.h>
 #include <coins.h>
+#include <crypto/common.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
 #include <vector>
@@ -85,3 +87,66 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Large caches, as seen during initial block download with a big -dbcache.
+static const uint32_t LARGE_CACHE_COINS = 10 * 1000 * 1000;
+
+static COutPoint LargeCacheOutPoint(uint32_t i)
+{
+    uint256 txid;
+    WriteLE32(txid.begin(), i);
+    return COutPoint(txid, i % 4);
+}
+
+static void FillLargeCache(CCoinsViewCache& cache)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 0) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (uint32_t i = 0; i < LARGE_CACHE_COINS; i++) {
+        cache.AddCoin(LargeCacheOutPoint(i), Coin(CTxOut(i, script), 1, false), false);
+    }
+}
+
+// Fill an empty cache with fresh coins, and free it.
+static void CCoinsCachingInsert(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    while (state.KeepRunning()) {
+        CCoinsViewCache cache(&coinsDummy);
+        FillLargeCache(cache);
+        assert(cache.GetCacheSize() == LARGE_CACHE_COINS);
+    }
+}
+
+// Random lookups of coins in a full cache.
+static void CCoinsCachingLookup(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache cache(&coinsDummy);
+    FillLargeCache(cache);
+    FastRandomContext rng(true);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1000 * 1000; i++) {
+            const Coin& coin = cache.AccessCoin(LargeCacheOutPoint(rng.randrange(LARGE_CACHE_COINS)));
+            assert(!coin.IsSpent());
+        }
+    }
+}
+
+// Fill a cache and flush it into the one below, as a block connecting cache
+// does into the chainstate cache. Includes the cost of CCoinsCachingInsert.
+static void CCoinsCachingFlush(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    while (state.KeepRunning()) {
+        CCoinsViewCache base(&coinsDummy);
+        CCoinsViewCache cache(&base);
+        FillLargeCache(cache);
+        bool success = cache.Flush();
+        assert(success);
+        assert(base.GetCacheSize() == LARGE_CACHE_COINS);
+    }
+}
+
+BENCHMARK(CCoinsCachingInsert, 1);
+BENCHMARK(CCoinsCachingLookup, 4);
+BENCHMARK(CCoinsCachingFlush, 1);
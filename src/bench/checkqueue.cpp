@@ -20,8 +20,9 @@ static const unsigned int QUEUE_BATCH_SIZE = 128;
 
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
-// and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+// and there is a little bit of work done between calls to Add. It is run
+// with several numbers of worker threads, to show how the queue scales.
+static void RunCCheckQueueSpeedPrevectorJob(benchmark::State& state, int nThreads)
 {
     struct PrevectorJob {
         prevector<PREVECTOR_SIZE, uint8_t> p;
@@ -38,7 +39,7 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     };
     CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < nThreads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
@@ -59,4 +60,18 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    RunCCheckQueueSpeedPrevectorJob(state, std::max(MIN_CORES, GetNumCores()));
+}
+static void CCheckQueueSpeedPrevectorJob_1Thread(benchmark::State& state) { RunCCheckQueueSpeedPrevectorJob(state, 1); }
+static void CCheckQueueSpeedPrevectorJob_4Threads(benchmark::State& state) { RunCCheckQueueSpeedPrevectorJob(state, 4); }
+static void CCheckQueueSpeedPrevectorJob_16Threads(benchmark::State& state) { RunCCheckQueueSpeedPrevectorJob(state, 16); }
+static void CCheckQueueSpeedPrevectorJob_32Threads(benchmark::State& state) { RunCCheckQueueSpeedPrevectorJob(state, 32); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_1Thread, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_4Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_16Threads, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob_32Threads, 1400);
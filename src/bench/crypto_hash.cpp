@@ -52,6 +52,41 @@ static void SHA256_32b(benchmark::State& state)
     }
 }
 
+static void SHA256_1block(benchmark::State& state)
+{
+    // 55 bytes is the largest input that fits, with padding, in one block.
+    std::vector<uint8_t> in(55, 0);
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    while (state.KeepRunning()) {
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+        in[0] = hash[0];
+    }
+}
+
+static void SHA256D_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32, 0);
+    while (state.KeepRunning()) {
+        CHash256().Write(in.data(), in.size()).Finalize(in.data());
+    }
+}
+
+static void SHA256D64_1(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1);
+    }
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -93,6 +128,10 @@ BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256_1block, 4700 * 1000);
+BENCHMARK(SHA256D_32b, 2400 * 1000);
+BENCHMARK(SHA256D64_1, 2400 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
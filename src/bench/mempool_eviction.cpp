@@ -112,3 +112,77 @@ static void MempoolEviction(benchmark::State& state)
 }
 
 BENCHMARK(MempoolEviction, 41000);
+
+// Insert a tree of transactions in which each spends an output of an earlier
+// one, so most have a parent and several children, then remove them again.
+static void MempoolInsertRemove(benchmark::State& state)
+{
+    const int nTxs = 1000;
+    const int nOutputs = 4;
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < nTxs; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i > 0) {
+            tx.vin[0].prevout = COutPoint(txs[(i - 1) / nOutputs]->GetHash(), (i - 1) % nOutputs);
+        }
+        tx.vin[0].scriptSig = CScript() << i;
+        tx.vout.resize(nOutputs);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            out.nValue = COIN;
+        }
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    CTxMemPool pool;
+    LockPoints lp;
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : txs) {
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, 4, lp));
+        }
+        // Removing the root takes all of its descendants with it.
+        pool.removeRecursive(*txs[0]);
+        assert(pool.size() == 0);
+    }
+}
+
+BENCHMARK(MempoolInsertRemove, 40);
+
+// Insert a transaction with many children, as a reorg can leave in the
+// mempool regardless of the descendant limit, then remove all of them.
+static void MempoolRemoveWide(benchmark::State& state)
+{
+    const int nChildren = 2000;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vout.resize(nChildren);
+    for (CTxOut& out : txParent.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    std::vector<CTransactionRef> txs{MakeTransactionRef(txParent)};
+    for (int i = 0; i < nChildren; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(txs[0]->GetHash(), i);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+
+    CTxMemPool pool;
+    LockPoints lp;
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : txs) {
+            pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000, 0, 1, false, 4, lp));
+        }
+        pool.removeRecursive(*txs[0]);
+        assert(pool.size() == 0);
+    }
+}
+
+BENCHMARK(MempoolRemoveWide, 20);
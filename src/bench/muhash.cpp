@@ -0,0 +1,55 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <crypto/muhash.h>
+#include <random.h>
+
+// The cost -muhash adds to ConnectBlock and DisconnectBlock: one of these for
+// every coin a block creates and one for every coin it spends.
+static Coin MakeCoin()
+{
+    CScript script;
+    script << OP_0 << std::vector<unsigned char>(20, 0x42);
+    return Coin(CTxOut(50000, script), 500000, false);
+}
+
+static void MuHashApplyCoin(benchmark::State& state)
+{
+    MuHash3072 muhash;
+    const Coin coin = MakeCoin();
+    COutPoint outpoint(GetRandHash(), 0);
+    while (state.KeepRunning()) {
+        ApplyCoinHash(muhash, outpoint, coin);
+        outpoint.n++;
+    }
+}
+
+static void MuHashRemoveCoin(benchmark::State& state)
+{
+    MuHash3072 muhash;
+    const Coin coin = MakeCoin();
+    COutPoint outpoint(GetRandHash(), 0);
+    while (state.KeepRunning()) {
+        RemoveCoinHash(muhash, outpoint, coin);
+        outpoint.n++;
+    }
+}
+
+// What gettxoutsetinfo "muhash" pays once per call.
+static void MuHashFinalize(benchmark::State& state)
+{
+    MuHash3072 muhash;
+    ApplyCoinHash(muhash, COutPoint(GetRandHash(), 0), MakeCoin());
+    RemoveCoinHash(muhash, COutPoint(GetRandHash(), 0), MakeCoin());
+    unsigned char out[MuHash3072::OUTPUT_SIZE];
+    while (state.KeepRunning()) {
+        muhash.Finalize(out);
+    }
+}
+
+BENCHMARK(MuHashApplyCoin, 50 * 1000);
+BENCHMARK(MuHashRemoveCoin, 50 * 1000);
+BENCHMARK(MuHashFinalize, 20);
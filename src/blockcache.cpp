@@ -0,0 +1,61 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <core_memusage.h>
+#include <memusage.h>
+#include <primitives/block.h>
+
+std::unique_ptr<CBlockCache> g_blockcache;
+
+CBlockCache::CBlockCache(size_t nMaxUsageIn) : nMaxUsage(nMaxUsageIn), nUsage(0), nHits(0), nMisses(0)
+{
+}
+
+std::shared_ptr<const CBlock> CBlockCache::Get(const uint256& hash)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = index.find(hash);
+    if (it == index.end()) {
+        nMisses++;
+        return nullptr;
+    }
+    nHits++;
+    entries.splice(entries.begin(), entries, it->second);
+    return it->second->pblock;
+}
+
+void CBlockCache::Add(const uint256& hash, const std::shared_ptr<const CBlock>& pblock)
+{
+    // The transactions may be shared with the mempool or other blocks, so this
+    // is an upper bound of what keeping the block here costs.
+    const size_t nBlockUsage = RecursiveDynamicUsage(pblock) + memusage::MallocUsage(sizeof(Entry) + 2 * sizeof(void*)) +
+        memusage::MallocUsage(sizeof(std::pair<const uint256, EntryList::iterator>) + sizeof(void*));
+
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = index.find(hash);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+    if (nBlockUsage > nMaxUsage) {
+        return;
+    }
+    while (nUsage + nBlockUsage > nMaxUsage) {
+        const Entry& last = entries.back();
+        nUsage -= last.nUsage;
+        index.erase(last.hash);
+        entries.pop_back();
+    }
+    entries.push_front(Entry{hash, pblock, nBlockUsage});
+    index.emplace(hash, entries.begin());
+    nUsage += nBlockUsage;
+}
+
+CBlockCache::Stats CBlockCache::GetStats()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    return Stats{entries.size(), nUsage, nMaxUsage, nHits, nMisses};
+}
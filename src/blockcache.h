@@ -0,0 +1,76 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <uint256.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+
+class CBlock;
+
+/** Default for -blockcache, the memory for recently used blocks in megabytes (0 disables it) */
+static const int64_t DEFAULT_BLOCK_CACHE = 64;
+
+/**
+ * A cache of recently connected or read blocks, so that requests for the
+ * same blocks from peers, RPC, REST and ZMQ don't read and deserialize them
+ * from disk over and over.
+ *
+ * Blocks are kept as shared pointers to const blocks, so that the callers can
+ * use them after they're evicted, and are evicted least recently used first
+ * once their memory usage exceeds the limit.
+ */
+class CBlockCache
+{
+private:
+    struct Entry {
+        uint256 hash;
+        std::shared_ptr<const CBlock> pblock;
+        size_t nUsage;
+    };
+    typedef std::list<Entry> EntryList;
+
+    struct EntryHasher
+    {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    std::mutex cs;
+    //! Most recently used first.
+    EntryList entries;
+    std::unordered_map<uint256, EntryList::iterator, EntryHasher> index;
+    const size_t nMaxUsage;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+
+public:
+    explicit CBlockCache(size_t nMaxUsageIn);
+
+    /** Look a block up by hash, and count the hit or miss. Returns nullptr if it isn't cached. */
+    std::shared_ptr<const CBlock> Get(const uint256& hash);
+
+    /** Add a block with the given hash, or mark it as recently used if it's there already. */
+    void Add(const uint256& hash, const std::shared_ptr<const CBlock>& pblock);
+
+    struct Stats {
+        size_t nBlocks;
+        size_t nUsage;
+        size_t nMaxUsage;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+    Stats GetStats();
+};
+
+/** Global cache of deserialized blocks, if enabled */
+extern std::unique_ptr<CBlockCache> g_blockcache;
+
+#endif // BITCOIN_BLOCKCACHE_H
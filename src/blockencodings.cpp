@@ -101,33 +101,57 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     if (shorttxids.size() != cmpctblock.shorttxids.size())
         return READ_STATUS_FAILED; // Short ID collision
 
+    // Most mempool transactions are not in the block, so before looking a
+    // short ID up in the map, check it against a small bitmap of the block's
+    // short IDs (16 bits each), which rules out about 94% of the others.
+    size_t filter_bits = 64;
+    while (filter_bits < shorttxids.size() * 16)
+        filter_bits *= 2;
+    const uint64_t filter_mask = filter_bits - 1;
+    std::vector<uint64_t> filter(filter_bits / 64);
+    for (const auto& shorttxid : shorttxids) {
+        filter[(shorttxid.first & filter_mask) >> 6] |= (uint64_t)1 << (shorttxid.first & 63);
+    }
+
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
-                mempool_count++;
-            } else {
-                // If we find two mempool txn that match the short id, just request it.
-                // This should be rare enough that the extra bandwidth doesn't matter,
-                // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
-                    mempool_count--;
+    // Hash the mempool in batches, apart from the lookups, so that the CPU
+    // can work on several independent hashes at once.
+    static const size_t SHORTID_BATCH_SIZE = 64;
+    uint64_t shortids[SHORTID_BATCH_SIZE];
+    for (size_t batch = 0; batch < vTxHashes.size() && mempool_count != shorttxids.size(); batch += SHORTID_BATCH_SIZE) {
+        const size_t batch_size = std::min(SHORTID_BATCH_SIZE, vTxHashes.size() - batch);
+        for (size_t j = 0; j < batch_size; j++) {
+            shortids[j] = cmpctblock.GetShortID(vTxHashes[batch + j].first);
+        }
+        for (size_t j = 0; j < batch_size; j++) {
+            const uint64_t shortid = shortids[j];
+            if (!(filter[(shortid & filter_mask) >> 6] & ((uint64_t)1 << (shortid & 63))))
+                continue;
+            std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
+            if (idit != shorttxids.end()) {
+                if (!have_txn[idit->second]) {
+                    txn_available[idit->second] = vTxHashes[batch + j].second->GetSharedTx();
+                    have_txn[idit->second]  = true;
+                    mempool_count++;
+                } else {
+                    // If we find two mempool txn that match the short id, just request it.
+                    // This should be rare enough that the extra bandwidth doesn't matter,
+                    // but eating a round-trip due to FillBlock failure would be annoying
+                    if (txn_available[idit->second]) {
+                        txn_available[idit->second].reset();
+                        mempool_count--;
+                    }
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids.size())
+                break;
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
     }
 
@@ -0,0 +1,194 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockimport.h>
+
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#include <limits>
+
+CBlockFileImporter::CBlockFileImporter(const CChainParams& chainparamsIn, int nCheckThreads) :
+    chainparams(chainparamsIn), fQuit(false), nNextFile(0), nEndFile(std::numeric_limits<int>::max()), nCurrentFile(0), nQueuedBytes(0)
+{
+    for (int i = 0; i < REINDEX_READ_THREADS; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()> >, "reindexread", std::function<void()>(std::bind(&CBlockFileImporter::ThreadReader, this)));
+    }
+    for (int i = 0; i < nCheckThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()> >, "reindexcheck", std::function<void()>(std::bind(&CBlockFileImporter::ThreadChecker, this)));
+    }
+}
+
+CBlockFileImporter::~CBlockFileImporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+    }
+    condReader.notify_all();
+    condChecker.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+bool CBlockFileImporter::Next(std::shared_ptr<CBlock>& pblock, CDiskBlockPos& pos)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    while (true) {
+        if (nCurrentFile >= nEndFile) return false;
+        auto it = files.find(nCurrentFile);
+        if (it != files.end()) {
+            File& file = it->second;
+            if (!file.slots.empty() && file.slots.front()->fDone) {
+                std::shared_ptr<Slot> slot = std::move(file.slots.front());
+                file.slots.pop_front();
+                nQueuedBytes -= slot->nSize;
+                condReader.notify_all();
+                pblock = std::move(slot->block);
+                pos = slot->pos;
+                return true;
+            }
+            if (file.slots.empty() && file.fDone) {
+                files.erase(it);
+                nCurrentFile++;
+                // The reader of the next file may go on regardless of the queue size now.
+                condReader.notify_all();
+                continue;
+            }
+        }
+        condNext.wait(lock);
+    }
+}
+
+void CBlockFileImporter::ThreadReader()
+{
+    while (true) {
+        int nFile;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (fQuit || nNextFile >= nEndFile) return;
+            nFile = nNextFile++;
+            files[nFile].fDone = false;
+        }
+        ReadFile(nFile);
+        std::lock_guard<std::mutex> lock(cs);
+        files[nFile].fDone = true;
+        condNext.notify_one();
+    }
+}
+
+void CBlockFileImporter::ReadFile(int nFile)
+{
+    CDiskBlockPos pos(nFile, 0);
+    FILE* file = nullptr;
+    if (fs::exists(GetBlockPosFilename(pos, "blk"))) {
+        file = OpenBlockFile(pos, true);
+    }
+    if (!file) {
+        // No block files left to reindex (an error opening it is logged in OpenBlockFile)
+        std::lock_guard<std::mutex> lock(cs);
+        nEndFile = std::min(nEndFile, nFile);
+        return;
+    }
+    LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+
+    try {
+        // This takes over file and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(file, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                blkdat.FindByte(chainparams.MessageStart()[0]);
+                nRewind = blkdat.GetPos()+1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+            {
+                // Don't read too far ahead of the blocks being imported.
+                std::unique_lock<std::mutex> lock(cs);
+                condReader.wait(lock, [&]{ return fQuit || nFile == nCurrentFile || nQueuedBytes < MAX_REINDEX_QUEUE_BYTES; });
+                if (fQuit) return;
+            }
+            try {
+                // read block, to be deserialized by a check thread
+                std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+                uint64_t nBlockPos = blkdat.GetPos();
+                slot->pos = CDiskBlockPos(nFile, nBlockPos);
+                slot->nSize = nSize;
+                slot->fDone = false;
+                blkdat.SetLimit(nBlockPos + nSize);
+                slot->raw.resize(nSize);
+                blkdat.read((char*)slot->raw.data(), nSize);
+                nRewind = blkdat.GetPos();
+
+                std::lock_guard<std::mutex> lock(cs);
+                files[nFile].slots.push_back(slot);
+                toCheck.emplace(std::make_pair(nFile, (unsigned int)nBlockPos), std::move(slot));
+                nQueuedBytes += nSize;
+                condChecker.notify_one();
+            } catch (const std::exception& e) {
+                LogPrintf("%s: I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: System error - %s\n", __func__, e.what());
+    }
+}
+
+void CBlockFileImporter::ThreadChecker()
+{
+    while (true) {
+        std::shared_ptr<Slot> slot;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condChecker.wait(lock, [this]{ return fQuit || !toCheck.empty(); });
+            if (fQuit) return;
+            // Blocks that are imported first are checked first.
+            slot = std::move(toCheck.begin()->second);
+            toCheck.erase(toCheck.begin());
+        }
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        try {
+            CDataStream stream(slot->raw, SER_DISK, CLIENT_VERSION);
+            std::vector<unsigned char>().swap(slot->raw);
+            stream >> *pblock;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize error - %s at %s\n", __func__, e.what(), slot->pos.ToString());
+            pblock.reset();
+        }
+        if (pblock) {
+            // This marks the block as checked, so AcceptBlock won't check it again. If it
+            // fails, AcceptBlock checks it again to find out why.
+            CValidationState state;
+            CheckBlock(*pblock, state, chainparams.GetConsensus());
+        }
+
+        std::lock_guard<std::mutex> lock(cs);
+        slot->block = std::move(pblock);
+        slot->fDone = true;
+        condNext.notify_one();
+    }
+}
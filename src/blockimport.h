@@ -0,0 +1,101 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include <chain.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CChainParams;
+
+/** -reindexthreads default (number of threads checking blocks during -reindex, 0 = auto) */
+static const int DEFAULT_REINDEX_THREADS = 0;
+/** Maximum number of threads checking blocks during -reindex */
+static const int MAX_REINDEX_THREADS = 16;
+/** Number of threads reading block files during -reindex */
+static const int REINDEX_READ_THREADS = 2;
+/** Maximum size of the blocks read ahead of the one being imported */
+static const size_t MAX_REINDEX_QUEUE_BYTES = 256 << 20;
+
+/**
+ * Reads all block files (blk?????.dat) and hands out the blocks they contain
+ * in file order, as -reindex needs them.
+ *
+ * REINDEX_READ_THREADS threads scan several block files at once for the
+ * message start and size that precede every block, and a pool of threads
+ * deserializes the blocks and runs CheckBlock on them. The caller takes the
+ * blocks with Next, one at a time, in the order in which they are stored,
+ * and inserts them into the block index itself.
+ *
+ * Blocks are read ahead of the caller up to MAX_REINDEX_QUEUE_BYTES, except
+ * in the file the caller is in, which is always read.
+ */
+class CBlockFileImporter
+{
+private:
+    struct Slot {
+        CDiskBlockPos pos;
+        unsigned int nSize;
+        std::vector<unsigned char> raw;
+        //! Whether the block went through the check threads (block is null if it didn't deserialize).
+        bool fDone;
+        std::shared_ptr<CBlock> block;
+    };
+
+    struct File {
+        //! Blocks found so far, in file order.
+        std::deque<std::shared_ptr<Slot>> slots;
+        //! Whether the whole file has been read.
+        bool fDone;
+    };
+
+    const CChainParams& chainparams;
+
+    std::mutex cs;
+    std::condition_variable condReader;
+    std::condition_variable condChecker;
+    std::condition_variable condNext;
+    bool fQuit;
+
+    //! Files being read, or read and not yet fully handed out.
+    std::map<int, File> files;
+    //! The next file a reader starts on.
+    int nNextFile;
+    //! The first block file that doesn't exist.
+    int nEndFile;
+    //! The file the caller takes blocks from.
+    int nCurrentFile;
+    //! Blocks waiting to be deserialized and checked, in file order.
+    std::map<std::pair<int, unsigned int>, std::shared_ptr<Slot>> toCheck;
+    //! Size of the blocks read and not yet handed out.
+    size_t nQueuedBytes;
+
+    std::vector<std::thread> threads;
+
+    void ThreadReader();
+    void ThreadChecker();
+    void ReadFile(int nFile);
+
+public:
+    CBlockFileImporter(const CChainParams& chainparamsIn, int nCheckThreads);
+    ~CBlockFileImporter();
+
+    /**
+     * Wait for the next block, in file order. Returns false once all block
+     * files have been handed out. pblock is null if the block at pos could
+     * not be deserialized.
+     */
+    bool Next(std::shared_ptr<CBlock>& pblock, CDiskBlockPos& pos);
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
@@ -0,0 +1,168 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockpipeline.h>
+
+#include <clientversion.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#include <algorithm>
+
+CBlockPipeline::CBlockPipeline(const Consensus::Params& consensusParamsIn, const CMessageHeader::MessageStartChars& messageStartIn, size_t nDepthIn, int nCheckThreads) :
+    consensusParams(consensusParamsIn), messageStart(messageStartIn), nDepth(nDepthIn), nMaxToCheck(2 * nCheckThreads), fQuit(false)
+{
+    threads.emplace_back(&TraceThread<std::function<void()> >, "piperead", std::function<void()>(std::bind(&CBlockPipeline::ThreadReader, this)));
+    for (int i = 0; i < nCheckThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()> >, "pipecheck", std::function<void()>(std::bind(&CBlockPipeline::ThreadChecker, this)));
+    }
+}
+
+CBlockPipeline::~CBlockPipeline()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+    }
+    condReader.notify_all();
+    condChecker.notify_all();
+    condDone.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void CBlockPipeline::Schedule(const CBlockIndex* pindexTip, const CBlockIndex* pindexTarget)
+{
+    AssertLockHeld(cs_main);
+    const int nTipHeight = pindexTip ? pindexTip->nHeight : -1;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        // Drop the blocks that were connected without us, or are not on the way to the target anymore.
+        for (auto it = entries.begin(); it != entries.end(); ) {
+            const CBlockIndex* pindex = it->first;
+            if (!pindexTarget || pindex->nHeight <= nTipHeight || pindexTarget->GetAncestor(pindex->nHeight) != pindex) {
+                it = entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        toRead.erase(std::remove_if(toRead.begin(), toRead.end(), [this](const CBlockIndex* pindex) { return !entries.count(pindex); }), toRead.end());
+        toCheck.erase(std::remove_if(toCheck.begin(), toCheck.end(), [this](const std::pair<const CBlockIndex*, std::vector<unsigned char>>& job) { return !entries.count(job.first); }), toCheck.end());
+
+        if (pindexTarget) {
+            const int nEndHeight = std::min(nTipHeight + (int)nDepth, pindexTarget->nHeight);
+            for (int nHeight = nTipHeight + 1; nHeight <= nEndHeight; nHeight++) {
+                const CBlockIndex* pindex = pindexTarget->GetAncestor(nHeight);
+                if (!(pindex->nStatus & BLOCK_HAVE_DATA)) break;
+                if (entries.count(pindex)) continue;
+                Entry entry;
+                entry.pos = pindex->GetBlockPos();
+                entry.hash = pindex->GetBlockHash();
+                entry.fDone = false;
+                entries.emplace(pindex, std::move(entry));
+                toRead.push_back(pindex);
+            }
+        }
+    }
+    condReader.notify_all();
+}
+
+std::shared_ptr<const CBlock> CBlockPipeline::Get(const CBlockIndex* pindex)
+{
+    std::unique_lock<std::mutex> lock(cs);
+    auto it = entries.find(pindex);
+    condDone.wait(lock, [&]{
+        it = entries.find(pindex);
+        return fQuit || it == entries.end() || it->second.fDone;
+    });
+    if (it == entries.end() || !it->second.fDone) return nullptr;
+    std::shared_ptr<const CBlock> pblock = std::move(it->second.block);
+    entries.erase(it);
+    return pblock;
+}
+
+void CBlockPipeline::ThreadReader()
+{
+    while (true) {
+        const CBlockIndex* pindex;
+        CDiskBlockPos pos;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            // Don't read further ahead than the checkers can keep up with.
+            condReader.wait(lock, [this]{ return fQuit || (!toRead.empty() && toCheck.size() < nMaxToCheck); });
+            if (fQuit) return;
+            pindex = toRead.front();
+            toRead.pop_front();
+            pos = entries.at(pindex).pos;
+        }
+        std::vector<unsigned char> raw;
+        bool fRead = ReadRawBlockFromDisk(raw, pos, messageStart);
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            auto it = entries.find(pindex);
+            if (it == entries.end()) continue;
+            if (!fRead) {
+                // ConnectTip will try again, and fail properly.
+                it->second.fDone = true;
+                condDone.notify_all();
+                continue;
+            }
+            toCheck.emplace_back(pindex, std::move(raw));
+        }
+        condChecker.notify_one();
+    }
+}
+
+void CBlockPipeline::ThreadChecker()
+{
+    while (true) {
+        std::pair<const CBlockIndex*, std::vector<unsigned char>> job;
+        uint256 hash;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condChecker.wait(lock, [this]{ return fQuit || !toCheck.empty(); });
+            if (fQuit) return;
+            job = std::move(toCheck.front());
+            toCheck.pop_front();
+            auto it = entries.find(job.first);
+            if (it == entries.end()) {
+                condReader.notify_one();
+                continue;
+            }
+            hash = it->second.hash;
+        }
+        condReader.notify_one();
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        try {
+            CDataStream stream(job.second, SER_DISK, CLIENT_VERSION);
+            std::vector<unsigned char>().swap(job.second);
+            stream >> *pblock;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize error - %s for %s\n", __func__, e.what(), hash.ToString());
+            pblock.reset();
+        }
+        if (pblock && pblock->GetHash() != hash) {
+            pblock.reset();
+        }
+        if (pblock) {
+            // This marks the block as checked, so ConnectBlock won't check it again. If
+            // it fails, ConnectBlock checks it again to find out why.
+            CValidationState state;
+            CheckBlock(*pblock, state, consensusParams);
+        }
+
+        std::lock_guard<std::mutex> lock(cs);
+        auto it = entries.find(job.first);
+        if (it != entries.end()) {
+            it->second.block = std::move(pblock);
+            it->second.fDone = true;
+            condDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPIPELINE_H
+#define BITCOIN_BLOCKPIPELINE_H
+
+#include <chain.h>
+#include <protocol.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlock;
+namespace Consensus { struct Params; }
+
+/** Default for -pipelineblocks, the number of blocks ahead of the tip that are read and checked in the background. */
+static const int DEFAULT_PIPELINE_BLOCKS = 16;
+/** Maximum value for -pipelineblocks. */
+static const int MAX_PIPELINE_BLOCKS = 128;
+/** Number of threads deserializing and checking blocks read by the pipeline. */
+static const int PIPELINE_CHECK_THREADS = 2;
+
+/**
+ * Reads and checks the blocks that are about to be connected, while the
+ * block before them is being connected.
+ *
+ * Without it, ConnectTip reads and deserializes each block, and CheckBlock
+ * verifies its merkle root and transactions, all on the thread holding
+ * cs_main, before the connect itself can start. The pipeline moves that work
+ * into two stages running ahead of the tip:
+ *
+ * - one thread reads the serialized blocks from disk, in chain order;
+ * - PIPELINE_CHECK_THREADS threads deserialize them and run CheckBlock.
+ *
+ * The stages hand blocks over through queues bounded by the pipeline depth,
+ * and ConnectTip, the last stage, takes the checked blocks with Get. A block
+ * that fails a check is handed over anyway, and ConnectBlock reports the
+ * failure as usual. Any block the pipeline can't deliver is read by
+ * ConnectTip itself.
+ */
+class CBlockPipeline
+{
+private:
+    struct Entry {
+        //! Where the block is stored, and its expected hash.
+        CDiskBlockPos pos;
+        uint256 hash;
+        //! Whether the block went through all stages (block may still be null if reading it failed).
+        bool fDone;
+        std::shared_ptr<const CBlock> block;
+    };
+
+    const Consensus::Params& consensusParams;
+    const CMessageHeader::MessageStartChars& messageStart;
+    //! Maximum number of blocks in the pipeline at once.
+    const size_t nDepth;
+    //! Maximum number of blocks read but not yet taken by a checker.
+    const size_t nMaxToCheck;
+
+    std::mutex cs;
+    std::condition_variable condReader;
+    std::condition_variable condChecker;
+    std::condition_variable condDone;
+    bool fQuit;
+
+    //! All blocks in the pipeline, in any stage.
+    std::map<const CBlockIndex*, Entry> entries;
+    //! Blocks waiting to be read.
+    std::deque<const CBlockIndex*> toRead;
+    //! Blocks waiting to be deserialized and checked.
+    std::deque<std::pair<const CBlockIndex*, std::vector<unsigned char>>> toCheck;
+
+    std::vector<std::thread> threads;
+
+    void ThreadReader();
+    void ThreadChecker();
+
+public:
+    CBlockPipeline(const Consensus::Params& consensusParamsIn, const CMessageHeader::MessageStartChars& messageStartIn, size_t nDepthIn, int nCheckThreads = PIPELINE_CHECK_THREADS);
+    ~CBlockPipeline();
+
+    /**
+     * Queue the blocks following pindexTip towards pindexTarget, and drop the
+     * ones that are no longer on the way there. Requires cs_main.
+     */
+    void Schedule(const CBlockIndex* pindexTip, const CBlockIndex* pindexTarget);
+
+    /**
+     * Take the block of pindex out of the pipeline, waiting for it to be
+     * checked if needed. Returns nullptr if it was not in the pipeline, or
+     * could not be read.
+     */
+    std::shared_ptr<const CBlock> Get(const CBlockIndex* pindex);
+};
+
+#endif // BITCOIN_BLOCKPIPELINE_H
@@ -0,0 +1,125 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockreadpool.h>
+
+#include <blockcache.h>
+#include <chain.h>
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+#include <future>
+
+std::unique_ptr<CBlockReadPool> g_blockreadpool;
+
+std::shared_ptr<const CBlock> ReadBlockFromPool(const CDiskBlockPos& pos, const uint256& hash, const Consensus::Params& consensusParams)
+{
+    if (g_blockcache) {
+        std::shared_ptr<const CBlock> pblock = g_blockcache->Get(hash);
+        if (pblock) return pblock;
+    }
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (g_blockreadpool) {
+        if (!g_blockreadpool->ReadBlock(*pblock, pos, hash, consensusParams)) return nullptr;
+    } else {
+        if (!ReadBlockFromDisk(*pblock, pos, consensusParams) || pblock->GetHash() != hash) return nullptr;
+    }
+    if (g_blockcache) {
+        g_blockcache->Add(hash, pblock);
+    }
+    return pblock;
+}
+
+CBlockReadPool::CBlockReadPool(int nThreads) : fQuit(false), nNextLocalId(-1)
+{
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()> >, "blockread", std::function<void()>(std::bind(&CBlockReadPool::ThreadRead, this)));
+    }
+}
+
+CBlockReadPool::~CBlockReadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+    }
+    cond.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void CBlockReadPool::Queue(NodeId id, std::function<void()> func)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        std::deque<std::function<void()>>& jobs = queued[id];
+        jobs.push_back(std::move(func));
+        // If a job of this requester is queued or running already, it is
+        // made ready once that one is done.
+        if (pending[id]++ == 0) {
+            ready.push_back(id);
+        }
+    }
+    cond.notify_one();
+}
+
+size_t CBlockReadPool::Pending(NodeId id)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    auto it = pending.find(id);
+    return it == pending.end() ? 0 : it->second;
+}
+
+bool CBlockReadPool::ReadBlock(CBlock& block, const CDiskBlockPos& pos, const uint256& hash, const Consensus::Params& consensusParams)
+{
+    NodeId id;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        id = nNextLocalId--;
+    }
+    std::promise<bool> promise;
+    Queue(id, [&] {
+        bool fRead = ReadBlockFromDisk(block, pos, consensusParams);
+        if (fRead && block.GetHash() != hash) {
+            fRead = error("%s: GetHash() doesn't match index for %s at %s", __func__, hash.ToString(), pos.ToString());
+        }
+        promise.set_value(fRead);
+    });
+    return promise.get_future().get();
+}
+
+void CBlockReadPool::ThreadRead()
+{
+    while (true) {
+        NodeId id;
+        std::function<void()> func;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this]{ return fQuit || !ready.empty(); });
+            if (ready.empty()) return;
+            id = ready.front();
+            ready.pop_front();
+            auto it = queued.find(id);
+            func = std::move(it->second.front());
+            it->second.pop_front();
+            if (it->second.empty()) {
+                queued.erase(it);
+            }
+        }
+        func();
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            auto it = pending.find(id);
+            if (--it->second == 0) {
+                pending.erase(it);
+            } else {
+                // Let the others have a turn before the next job of this requester.
+                ready.push_back(id);
+                cond.notify_one();
+            }
+        }
+    }
+}
@@ -0,0 +1,89 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKREADPOOL_H
+#define BITCOIN_BLOCKREADPOOL_H
+
+#include <net.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlock;
+struct CDiskBlockPos;
+namespace Consensus { struct Params; }
+
+/** Default for -blockreadthreads, the number of threads reading blocks from disk for peers and RPC (0 reads them inline) */
+static const int DEFAULT_BLOCK_READ_THREADS = 4;
+/** Maximum value for -blockreadthreads. */
+static const int MAX_BLOCK_READ_THREADS = 16;
+/** Maximum number of block requests of one peer that are waiting to be read or being read. */
+static const size_t MAX_BLOCK_READS_PER_PEER = 4;
+
+/**
+ * A bounded pool of threads that read blocks from disk, so that slow reads
+ * of historical blocks don't stall the thread that asked for them.
+ *
+ * Jobs are queued per requester, and run one at a time for each, in the
+ * order they were queued, so that responses to a peer go out in the order
+ * the peer asked for them. The threads take turns between requesters, and
+ * ProcessGetData queues at most MAX_BLOCK_READS_PER_PEER jobs per peer, so
+ * one peer downloading old blocks can't keep the disk to itself.
+ */
+class CBlockReadPool
+{
+private:
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fQuit;
+
+    //! Jobs not started yet, per requester.
+    std::map<NodeId, std::deque<std::function<void()>>> queued;
+    //! Number of jobs per requester that are queued or running.
+    std::map<NodeId, size_t> pending;
+    //! Requesters with queued jobs and none running, in turn.
+    std::deque<NodeId> ready;
+    //! Ids for requesters that are not peers (counting down from -1).
+    NodeId nNextLocalId;
+
+    std::vector<std::thread> threads;
+
+    void ThreadRead();
+
+public:
+    explicit CBlockReadPool(int nThreads);
+    //! Runs the jobs still queued before returning.
+    ~CBlockReadPool();
+
+    /** Run func on a pool thread, after the jobs queued earlier for the same requester. */
+    void Queue(NodeId id, std::function<void()> func);
+
+    /** Number of jobs of a requester that are queued or running. */
+    size_t Pending(NodeId id);
+
+    /**
+     * Read a block in the pool and wait for it, for callers without a
+     * requester of their own. Returns false if the block at pos can't be read
+     * or doesn't have the given hash.
+     */
+    bool ReadBlock(CBlock& block, const CDiskBlockPos& pos, const uint256& hash, const Consensus::Params& consensusParams);
+};
+
+/** Global pool reading blocks for peers and RPC, if enabled */
+extern std::unique_ptr<CBlockReadPool> g_blockreadpool;
+
+/**
+ * Get the block at pos, with the given hash, for an RPC, REST or ZMQ request:
+ * from g_blockcache if it's there, or else read in g_blockreadpool if enabled,
+ * or on the calling thread. Returns nullptr if it can't be read.
+ */
+std::shared_ptr<const CBlock> ReadBlockFromPool(const CDiskBlockPos& pos, const uint256& hash, const Consensus::Params& consensusParams);
+
+#endif // BITCOIN_BLOCKREADPOOL_H
@@ -31,6 +31,17 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+/** A UTXO set snapshot trusted without -assumeutxo. */
+struct AssumedTxOutSet {
+    //! Hash of the UTXO set, as hash_serialized_2 of gettxoutsetinfo.
+    uint256 hashSerialized;
+    //! Number of transactions in the chain up to and including the snapshot's block.
+    uint64_t nChainTx;
+};
+
+/** UTXO set snapshots trusted without -assumeutxo, by block hash. */
+typedef std::map<uint256, AssumedTxOutSet> MapAssumedTxOutSets;
+
 struct ChainTxData {
     int64_t nTime;
     int64_t nTxCount;
@@ -77,6 +88,7 @@ public:
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
+    const MapAssumedTxOutSets& AssumedTxOutSets() const { return mapAssumedTxOutSets; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
 protected:
     CChainParams() {}
@@ -96,6 +108,7 @@ protected:
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumedTxOutSets mapAssumedTxOutSets;
 };
 
 /**
@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -25,12 +28,39 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker has a queue of its own, and the master spreads the
+  * verifications it adds over them. Workers take batches from their own
+  * queue, and steal from the others when it runs dry, so they only contend
+  * with each other for the small per-queue locks. The shared mutex is only
+  * taken to go to sleep and wake up.
   */
 template <typename T>
 class CCheckQueue
 {
+public:
+    //! Maximum number of queues the verifications are spread over.
+    static const unsigned int MAX_QUEUES = 64;
+
 private:
-    //! Mutex to protect the inner state
+    //! The verifications waiting for one worker, which others may steal from.
+    struct WorkerQueue
+    {
+        boost::mutex mutex;
+        //! Taken from the back by the owner, and from the front by thieves.
+        std::deque<T> checks;
+    };
+
+    //! Queue 0 belongs to the master, the others to the workers in the order they start.
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    //! The number of workers that have started.
+    std::atomic<unsigned int> nWorkers;
+
+    //! The queue the master adds the next verifications to. Only used by the master.
+    unsigned int nNextQueue;
+
+    //! Mutex to go to sleep and wake up with
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,25 +69,25 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The number of elements in all queues. It may briefly be negative while
+    //! elements that are being added are already taken.
+    std::atomic<int> nQueued;
 
     //! The number of workers (including the master) that are idle.
-    int nIdle;
+    std::atomic<int> nIdle;
 
     //! The total number of workers (including the master).
     int nTotal;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
     //! Whether we're shutting down.
     bool fQuit;
@@ -65,30 +95,66 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! The number of queues in use.
+    unsigned int NumQueues() const
+    {
+        return std::min(nWorkers.load() + 1, MAX_QUEUES);
+    }
+
+    /**
+     * Take a batch of verifications into vChecks, from queue nHome or else from
+     * another one. Returns false if all queues are empty.
+     */
+    bool Take(unsigned int nHome, std::vector<T>& vChecks)
+    {
+        const unsigned int nQueues = NumQueues();
+        for (unsigned int i = 0; i < nQueues; i++) {
+            WorkerQueue& queue = *queues[(nHome + i) % nQueues];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            if (queue.checks.empty()) {
+                continue;
+            }
+            // Decide how many work units to process now.
+            // * From our own queue, aim for increasingly smaller batches so all
+            //   workers finish approximately simultaneously, and leave a share
+            //   for the idle workers which will instantly start helping.
+            // * From another queue, steal half of what is left.
+            // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+            const unsigned int nSize = queue.checks.size();
+            const unsigned int nNow = std::max(1U, std::min(nBatchSize, i == 0 ? nSize / (nIdle + 1) : nSize / 2));
+            vChecks.resize(nNow);
+            for (unsigned int j = 0; j < nNow; j++) {
+                // We want the lock on the mutex to be as short as possible, so swap jobs from the
+                // queue to the local batch vector instead of copying.
+                if (i == 0) {
+                    vChecks[j].swap(queue.checks.back());
+                    queue.checks.pop_back();
+                } else {
+                    vChecks[j].swap(queue.checks.front());
+                    queue.checks.pop_front();
+                }
+            }
+            nQueued -= nNow;
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const unsigned int nHome = fMaster ? 0 : 1 + nWorkers++ % (MAX_QUEUES - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nTotal++;
+        }
         do {
-            {
+            if (!Take(nHome, vChecks)) {
                 boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
+                while (nQueued <= 0) {
                     if ((fMaster || fQuit) && nTodo == 0) {
                         nTotal--;
                         bool fRet = fAllOk;
@@ -102,27 +168,23 @@ private:
                     cond.wait(lock); // wait
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                continue;
             }
+            // Check whether we need to do work at all
+            bool fOk = fAllOk;
             // execute work
             for (T& check : vChecks)
                 if (fOk)
                     fOk = check();
+            const unsigned int nNow = vChecks.size();
             vChecks.clear();
+            if (!fOk)
+                fAllOk = false;
+            if ((nTodo -= nNow) == 0 && !fMaster) {
+                // We processed the last element; inform the master it can exit and return the result
+                boost::unique_lock<boost::mutex> lock(mutex);
+                condMaster.notify_one();
+            }
         } while (true);
     }
 
@@ -131,7 +193,12 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nNextQueue(0), nQueued(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < MAX_QUEUES; i++) {
+            queues.emplace_back(new WorkerQueue);
+        }
+    }
 
     //! Worker thread
     void Thread()
@@ -148,16 +215,31 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        // Spread the checks evenly over the queues, in turns.
+        const unsigned int nQueues = NumQueues();
+        const size_t nPerQueue = (vChecks.size() + nQueues - 1) / nQueues;
+        size_t nAdded = 0;
+        while (nAdded < vChecks.size()) {
+            WorkerQueue& queue = *queues[nNextQueue % nQueues];
+            nNextQueue = (nNextQueue + 1) % nQueues;
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            for (size_t i = 0; i < nPerQueue && nAdded < vChecks.size(); i++, nAdded++) {
+                queue.checks.emplace_back();
+                queue.checks.back().swap(vChecks[nAdded]);
+            }
+        }
+        nQueued += vChecks.size();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        // Only wake up as many workers as there are checks to do.
+        if (vChecks.size() >= (size_t)nIdle) {
             condWorker.notify_all();
+        } else {
+            for (size_t i = 0; i < vChecks.size(); i++)
+                condWorker.notify_one();
+        }
     }
 
     ~CCheckQueue()
@@ -9,9 +9,11 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -84,8 +86,8 @@ public:
 class SaltedOutpointHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, so that maps using this hasher can be swapped) */
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -104,6 +106,7 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    bool used; // Accessed since the last time eviction looked at this entry.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -115,11 +118,20 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), used(false) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), used(false) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The entries of a CCoinsMap are pooled: allocated in large chunks rather than
+ * one by one, which saves the per-allocation overhead of malloc for each coin
+ * and makes the memory usage of the map exact.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + 4 * sizeof(void*),
+                      alignof(void*)> CCoinsMapAllocator;
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -157,15 +169,20 @@ public:
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
+    //! Retrieve the hash of the multiset of coins in this view, as of GetBestBlock()
+    virtual MuHash3072 GetMuHash() const;
+
     //! Retrieve the range of blocks that may have been only partially written.
     //! If the database is in a consistent state, the result is the empty vector.
     //! Otherwise, a two-element vector is returned consisting of the new and
     //! the old block hash, in that order.
     virtual std::vector<uint256> GetHeadBlocks() const;
 
-    //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! Do a bulk modification (multiple Coin changes + BestBlock change, with
+    //! the hash of the coins as of that block).
+    //! If erase is true, the passed mapCoins can be modified. Otherwise it is
+    //! left untouched, so that it can keep being read while it is written.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const MuHash3072 &muhash, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -189,9 +206,10 @@ public:
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
+    MuHash3072 GetMuHash() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const MuHash3072 &muhash, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -208,9 +226,21 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
+    /* Hash of the coins as of hashBlock, once fetched from the base view. */
+    mutable MuHash3072 muhash;
+    mutable bool fHaveMuHash;
+
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Lookups answered by this cache, and passed on to the base view. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+    uint64_t nCacheEvicted;
+
+    /* Where the next eviction pass starts, if still in the cache. */
+    COutPoint evictionHand;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -224,7 +254,9 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    MuHash3072 GetMuHash() const override;
+    void SetMuHash(const MuHash3072 &muhash);
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const MuHash3072 &muhash, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -268,6 +300,22 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached, as unmodified entries.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Remove unmodified entries that were not accessed recently (approximating
+     * least recently used, CLOCK style), until the memory usage of the cache
+     * is at most nTargetUsage bytes or only modified entries are left.
+     * The memory of removed entries stays with the cache for new ones, see
+     * InUseMemoryUsage(). Returns the number of entries removed.
+     */
+    size_t Evict(size_t nTargetUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -280,6 +328,15 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Like DynamicMemoryUsage(), without memory freed by removed entries and kept for reuse.
+    size_t InUseMemoryUsage() const;
+
+    //! Number of lookups answered from the cache, and passed on to the base view.
+    uint64_t GetHits() const { return nCacheHits; }
+    uint64_t GetMisses() const { return nCacheMisses; }
+    //! Number of entries removed by Evict().
+    uint64_t GetEvicted() const { return nCacheEvicted; }
+
     /** 
      * Amount of bitcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -311,4 +368,8 @@ void AddCoins(CCoinsViewCache& cache, const CTransaction& tx, int nHeight, bool
 // lookups to database, so it should be used with care.
 const Coin& AccessByTxid(const CCoinsViewCache& cache, const uint256& txid);
 
+//! Add a coin to, or remove it from, a hash of the UTXO set.
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
 #endif // BITCOIN_COINS_H
@@ -0,0 +1,196 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinsprefetch.h>
+
+#include <primitives/block.h>
+#include <util.h>
+#include <validation.h>
+
+#include <iterator>
+#include <unordered_set>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* viewIn, const Consensus::Params& consensusParamsIn, int nThreads) :
+    CCoinsViewBacked(viewIn), consensusParams(consensusParamsIn), fQuit(false), nGeneration(0), nHits(0), nMisses(0), pindexLastQueued(nullptr)
+{
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(&TraceThread<std::function<void()> >, "prefetch", std::function<void()>(std::bind(&CCoinsViewPrefetch::ThreadWorker, this)));
+    }
+}
+
+CCoinsViewPrefetch::~CCoinsViewPrefetch()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+        jobs.clear();
+    }
+    condWorker.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+bool CCoinsViewPrefetch::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        auto it = prefetched.find(outpoint);
+        if (it != prefetched.end()) {
+            // The cache above us keeps its own copy from now on.
+            coin = std::move(it->second);
+            prefetched.erase(it);
+            ++nHits;
+            return true;
+        }
+    }
+    ++nMisses;
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewPrefetch::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (prefetched.count(outpoint)) return true;
+    }
+    return base->HaveCoin(outpoint);
+}
+
+void CCoinsViewPrefetch::Invalidate()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    ++nGeneration;
+    prefetched.clear();
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase)
+{
+    // Lookups that started before the write may return either the old or the
+    // new state, so drop everything loaded up to now, and make sure nothing
+    // that is in flight during the write gets stored.
+    Invalidate();
+    bool ret = base->BatchWrite(mapCoins, hashBlock, muhash, erase);
+    Invalidate();
+    return ret;
+}
+
+void CCoinsViewPrefetch::PrefetchBlock(const CDiskBlockPos& pos)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        Job job;
+        job.pos = pos;
+        jobs.push_back(std::move(job));
+    }
+    condWorker.notify_one();
+}
+
+void CCoinsViewPrefetch::PrefetchAhead(const CBlockIndex* pindexTip, const CBlockIndex* pindexTarget, int nBlocks)
+{
+    AssertLockHeld(cs_main);
+    if (nBlocks <= 0 || !pindexTip || !pindexTarget || pindexTarget->nHeight <= pindexTip->nHeight) return;
+    {
+        // Coins the cache above already had are never asked for; once those fill
+        // up the side cache, start over rather than stop prefetching.
+        std::lock_guard<std::mutex> lock(cs);
+        if (prefetched.size() >= MAX_PREFETCH_COINS) {
+            ++nGeneration;
+            prefetched.clear();
+        }
+    }
+    int nHeight = pindexTip->nHeight + 1;
+    // Continue after what was queued before, if that is still on the way to the target.
+    if (pindexLastQueued && pindexLastQueued->nHeight >= nHeight && pindexLastQueued->nHeight <= pindexTarget->nHeight &&
+        pindexTarget->GetAncestor(pindexLastQueued->nHeight) == pindexLastQueued) {
+        nHeight = pindexLastQueued->nHeight + 1;
+    }
+    int nEndHeight = std::min(pindexTip->nHeight + nBlocks, pindexTarget->nHeight);
+    for (; nHeight <= nEndHeight; nHeight++) {
+        const CBlockIndex* pindex = pindexTarget->GetAncestor(nHeight);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) break;
+        PrefetchBlock(pindex->GetBlockPos());
+        pindexLastQueued = pindex;
+    }
+}
+
+void CCoinsViewPrefetch::ProcessBlock(const CDiskBlockPos& pos)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos, consensusParams)) return;
+
+    // Inputs spending outputs of the same block are not in the database.
+    std::unordered_set<uint256, BlockHasher> txids;
+    std::vector<COutPoint> outpoints;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!txids.count(txin.prevout.hash)) {
+                    outpoints.push_back(txin.prevout);
+                }
+            }
+        }
+        txids.insert(tx->GetHash());
+    }
+
+    // Hand out all but the first batch to other threads.
+    std::vector<COutPoint> first;
+    std::vector<Job> batches;
+    for (size_t i = 0; i < outpoints.size(); i += PREFETCH_BATCH_SIZE) {
+        size_t end = std::min(outpoints.size(), i + PREFETCH_BATCH_SIZE);
+        if (i == 0) {
+            first.assign(outpoints.begin(), outpoints.begin() + end);
+            continue;
+        }
+        Job job;
+        job.outpoints.assign(outpoints.begin() + i, outpoints.begin() + end);
+        batches.push_back(std::move(job));
+    }
+    {
+        // The batches go ahead of the blocks queued after this one, in the
+        // order in which their coins will be needed.
+        std::lock_guard<std::mutex> lock(cs);
+        jobs.insert(jobs.begin(), std::make_move_iterator(batches.begin()), std::make_move_iterator(batches.end()));
+    }
+    condWorker.notify_all();
+    ProcessOutpoints(first);
+}
+
+void CCoinsViewPrefetch::ProcessOutpoints(const std::vector<COutPoint>& outpoints)
+{
+    for (const COutPoint& outpoint : outpoints) {
+        uint64_t nGenerationStart;
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (fQuit) return;
+            if (prefetched.size() >= MAX_PREFETCH_COINS || prefetched.count(outpoint)) continue;
+            nGenerationStart = nGeneration;
+        }
+        Coin coin;
+        if (!base->GetCoin(outpoint, coin)) continue;
+        std::lock_guard<std::mutex> lock(cs);
+        if (nGeneration == nGenerationStart) {
+            prefetched.emplace(outpoint, std::move(coin));
+        }
+    }
+}
+
+void CCoinsViewPrefetch::ThreadWorker()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWorker.wait(lock, [this]{ return fQuit || !jobs.empty(); });
+            if (fQuit) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        if (!job.pos.IsNull()) {
+            ProcessBlock(job.pos);
+        } else {
+            ProcessOutpoints(job.outpoints);
+        }
+    }
+}
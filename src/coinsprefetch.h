@@ -0,0 +1,100 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSPREFETCH_H
+#define BITCOIN_COINSPREFETCH_H
+
+#include <chain.h>
+#include <coins.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Consensus { struct Params; }
+
+/** Default for -prefetchblocks, the number of blocks ahead of the tip whose inputs are loaded in the background. */
+static const int DEFAULT_PREFETCH_BLOCKS = 8;
+/** Maximum value for -prefetchblocks. */
+static const int MAX_PREFETCH_BLOCKS = 128;
+/** Number of threads loading prefetched coins from the database. */
+static const int PREFETCH_THREADS = 4;
+/** Number of outpoints looked up per job by a prefetch thread. */
+static const size_t PREFETCH_BATCH_SIZE = 128;
+/** Maximum number of prefetched coins kept around waiting to be used. */
+static const size_t MAX_PREFETCH_COINS = 1 << 18;
+
+/**
+ * CCoinsView that sits between the coins cache and the coins database, and
+ * serves coins that worker threads loaded from the database ahead of time.
+ *
+ * During block connection each input that misses the cache becomes a blocking
+ * database read. Given the blocks that are about to be connected, this view
+ * reads them from disk and looks up their inputs in parallel, so that the
+ * lookups by ConnectBlock are answered from memory.
+ *
+ * Prefetched coins are copies of what the database contained when they were
+ * read. They are handed out at most once (after that the cache above holds
+ * them), and all of them are discarded whenever the database is written to,
+ * so they can never be staler than the database itself.
+ */
+class CCoinsViewPrefetch final : public CCoinsViewBacked
+{
+private:
+    struct Job {
+        //! Position of a block whose inputs to load, if not null.
+        CDiskBlockPos pos;
+        //! Otherwise, the outpoints to load.
+        std::vector<COutPoint> outpoints;
+    };
+
+    const Consensus::Params& consensusParams;
+
+    mutable std::mutex cs;
+    std::condition_variable condWorker;
+    std::deque<Job> jobs;
+    bool fQuit;
+
+    //! Coins loaded ahead of time, not yet handed out.
+    mutable std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> prefetched;
+    //! Incremented whenever the database is written to.
+    uint64_t nGeneration;
+
+    mutable std::atomic<uint64_t> nHits;
+    mutable std::atomic<uint64_t> nMisses;
+
+    std::vector<std::thread> threads;
+
+    //! The last block queued by PrefetchAhead, to avoid queueing blocks twice. Protected by cs_main.
+    const CBlockIndex* pindexLastQueued;
+
+    void ThreadWorker();
+    void ProcessBlock(const CDiskBlockPos& pos);
+    void ProcessOutpoints(const std::vector<COutPoint>& outpoints);
+    void Invalidate();
+
+public:
+    CCoinsViewPrefetch(CCoinsView* viewIn, const Consensus::Params& consensusParamsIn, int nThreads = PREFETCH_THREADS);
+    ~CCoinsViewPrefetch();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase = true) override;
+
+    /** Queue the inputs of the block at pos to be loaded in the background. */
+    void PrefetchBlock(const CDiskBlockPos& pos);
+
+    /** Queue the blocks following pindexTip towards pindexTarget, up to nBlocks ahead. */
+    void PrefetchAhead(const CBlockIndex* pindexTip, const CBlockIndex* pindexTarget, int nBlocks);
+
+    //! Number of lookups answered from, and missed by, prefetched coins.
+    uint64_t GetHits() const { return nHits; }
+    uint64_t GetMisses() const { return nMisses; }
+};
+
+#endif // BITCOIN_COINSPREFETCH_H
@@ -0,0 +1,83 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstats.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <serialize.h>
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+#include <boost/thread/thread.hpp> // boost::this_thread::interruption_point
+
+void AddStats(CCoinsStats& total, const CCoinsStats& stats)
+{
+    total.nTransactions += stats.nTransactions;
+    total.nTransactionOutputs += stats.nTransactionOutputs;
+    total.nBogoSize += stats.nBogoSize;
+    total.nTotalAmount += stats.nTotalAmount;
+}
+
+bool ForEachTransaction(CCoinsViewCursor& cursor, const std::function<void(const uint256&, const std::map<uint32_t, Coin>&)>& fn)
+{
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (cursor.Valid()) {
+        COutPoint key;
+        Coin coin;
+        if (cursor.GetKey(key) && cursor.GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                fn(prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        cursor.Next();
+    }
+    if (!outputs.empty()) {
+        fn(prevkey, outputs);
+    }
+    return true;
+}
+
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats)
+{
+    std::unique_ptr<CDBSnapshot> snapshot = view->GetSnapshot();
+    stats.hashBlock = view->GetBestBlock(*snapshot);
+    {
+        LOCK(cs_main);
+        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+    }
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+    // Every range is serialized into a buffer of its own, which is hashed
+    // once all ranges before it have been.
+    std::vector<CCoinsStats> vRangeStats(COIN_WALK_RANGES);
+    std::vector<std::vector<unsigned char>> vRangeData(COIN_WALK_RANGES);
+    bool fWalked = view->WalkCoins(*snapshot, [&](CCoinsViewCursor& cursor, size_t nRange) {
+        CVectorWriter writer(SER_GETHASH, PROTOCOL_VERSION, vRangeData[nRange], 0);
+        return ForEachTransaction(cursor, [&](const uint256& hash, const std::map<uint32_t, Coin>& outputs) {
+            ApplyStats(vRangeStats[nRange], writer, hash, outputs);
+        });
+    }, [&](size_t nRange) {
+        boost::this_thread::interruption_point();
+        ss.write((const char*)vRangeData[nRange].data(), vRangeData[nRange].size());
+        std::vector<unsigned char>().swap(vRangeData[nRange]);
+        AddStats(stats, vRangeStats[nRange]);
+    });
+    if (!fWalked) {
+        return false;
+    }
+    stats.hashSerialized = ss.GetHash();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include <amount.h>
+#include <coins.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <functional>
+#include <map>
+#include <stdint.h>
+
+class CCoinsViewDB;
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/**
+ * Add the unspent outputs of one transaction to the statistics, and to the
+ * hash of the UTXO set being computed in ss. Outputs of a transaction must be
+ * added all at once, in the order of the UTXO database. ss may also be a
+ * buffer that is hashed later on, in the same order.
+ */
+template<typename Stream>
+void ApplyStats(CCoinsStats& stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue);
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+    }
+    ss << VARINT(0);
+}
+
+//! Add the counters of stats, for another part of the UTXO set, to total.
+void AddStats(CCoinsStats& total, const CCoinsStats& stats);
+
+/**
+ * Call fn with the unspent outputs of every transaction the cursor goes over,
+ * in order. Returns false if a coin cannot be read.
+ */
+bool ForEachTransaction(CCoinsViewCursor& cursor, const std::function<void(const uint256&, const std::map<uint32_t, Coin>&)>& fn);
+
+/**
+ * Calculate statistics about the unspent transaction output set. The database
+ * is walked on several threads; the hash is computed over the ranges in order,
+ * so it does not depend on the number of threads.
+ */
+bool GetUTXOStats(CCoinsViewDB* view, CCoinsStats& stats);
+
+#endif // BITCOIN_COINSTATS_H
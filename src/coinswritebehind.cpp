@@ -0,0 +1,164 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinswritebehind.h>
+
+#include <memusage.h>
+#include <util.h>
+#include <utiltime.h>
+
+CCoinsViewWriteBehind::CCoinsViewWriteBehind(CCoinsView* viewIn) :
+    CCoinsViewBacked(viewIn), fWriting(false), fFailed(false), fQuit(false), nPendingUsage(0), fUsageKnown(true)
+{
+    thread = std::thread(&TraceThread<std::function<void()> >, "coinswrite", std::function<void()>(std::bind(&CCoinsViewWriteBehind::ThreadWriter, this)));
+}
+
+CCoinsViewWriteBehind::~CCoinsViewWriteBehind()
+{
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+    }
+    condWriter.notify_one();
+    thread.join();
+}
+
+bool CCoinsViewWriteBehind::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        CCoinsMap::iterator it = mapPending.find(outpoint);
+        if (it != mapPending.end()) {
+            if (fWriting || it->second.coin.IsSpent()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+            // Written already: the cache above keeps the coin from now on.
+            nPendingUsage -= it->second.coin.DynamicMemoryUsage();
+            coin = std::move(it->second.coin);
+            mapPending.erase(it);
+            return true;
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewWriteBehind::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapPending.find(outpoint);
+        if (it != mapPending.end()) {
+            return !it->second.coin.IsSpent();
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewWriteBehind::GetBestBlock() const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting) return hashPending;
+    }
+    return base->GetBestBlock();
+}
+
+MuHash3072 CCoinsViewWriteBehind::GetMuHash() const
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (fWriting) return muhashPending;
+    }
+    return base->GetMuHash();
+}
+
+bool CCoinsViewWriteBehind::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase)
+{
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        condDone.wait(lock, [this]{ return !fWriting; });
+        if (fFailed) return false;
+        // The entries of the last write are on disk. Leave freeing them to
+        // the writer thread, as the caller is likely to hold cs_main.
+        assert(mapRelease.empty());
+        mapRelease.swap(mapPending);
+        if (erase) {
+            // Take over the whole map; the caller is left with an empty one.
+            mapPending.swap(mapCoins);
+        } else {
+            for (const auto& entry : mapCoins) {
+                if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+                    mapPending.insert(entry);
+                }
+            }
+        }
+        hashPending = hashBlock;
+        muhashPending = muhash;
+        nPendingUsage = memusage::DynamicUsage(mapPending);
+        fUsageKnown = false;
+        fWriting = true;
+    }
+    condWriter.notify_one();
+    return true;
+}
+
+size_t CCoinsViewWriteBehind::DynamicMemoryUsage() const
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condDone.wait(lock, [this]{ return fUsageKnown; });
+    return nPendingUsage;
+}
+
+bool CCoinsViewWriteBehind::Wait()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condDone.wait(lock, [this]{ return !fWriting; });
+    return !fFailed;
+}
+
+void CCoinsViewWriteBehind::ThreadWriter()
+{
+    while (true) {
+        CCoinsMap mapDone;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            condWriter.wait(lock, [this]{ return fQuit || fWriting; });
+            if (fQuit) return;
+            mapDone.swap(mapRelease);
+        }
+        CCoinsMap().swap(mapDone);
+
+        // mapPending, hashPending and muhashPending are not modified while fWriting is set, so
+        // they can be read without holding cs, concurrently with lookups.
+        size_t nCoinsUsage = 0;
+        for (const auto& entry : mapPending) {
+            nCoinsUsage += entry.second.coin.DynamicMemoryUsage();
+        }
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            nPendingUsage += nCoinsUsage;
+            fUsageKnown = true;
+        }
+        condDone.notify_all();
+
+        int64_t nStart = GetTimeMicros();
+        bool fOk;
+        try {
+            fOk = base->BatchWrite(mapPending, hashPending, muhashPending, false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            fOk = false;
+        }
+        LogPrint(BCLog::COINDB, "Wrote %u cache entries up to block %s in the background (%.2fms)\n", mapPending.size(), hashPending.ToString(), (GetTimeMicros() - nStart) * 0.001);
+
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            if (!fOk) fFailed = true;
+            fWriting = false;
+        }
+        condDone.notify_all();
+    }
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSWRITEBEHIND_H
+#define BITCOIN_COINSWRITEBEHIND_H
+
+#include <coins.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/** Default for -asyncflush, whether periodic and cache size triggered chainstate flushes are written in the background. */
+static const bool DEFAULT_ASYNC_FLUSH = true;
+
+/**
+ * CCoinsView that writes the changes flushed into it to its base view on a
+ * background thread.
+ *
+ * BatchWrite takes over the flushed entries and returns right away, so the
+ * cache above can continue on an empty map while the database is written.
+ * Until the write is done, lookups are answered from the entries being
+ * written before falling through to the base view, which is therefore never
+ * observed in a partially written state. A non-erasing BatchWrite, as done
+ * by CCoinsViewCache::Sync, has to copy the modified entries instead, so the
+ * cache above is meant to be written with Flush.
+ *
+ * Once written, the entries are kept as an older generation of the cache
+ * above, until the next BatchWrite replaces them. Lookups of unspent coins
+ * among them move those back up into that cache, so that only the coins that
+ * were not used between two writes are dropped.
+ *
+ * Only one write is in flight at a time: a BatchWrite while another is still
+ * being written first waits for that one to finish. Crash consistency is left
+ * to the base view, as every write ends up in a single BatchWrite call on it.
+ */
+class CCoinsViewWriteBehind final : public CCoinsViewBacked
+{
+private:
+    mutable std::mutex cs;
+    std::condition_variable condWriter;
+    mutable std::condition_variable condDone;
+
+    //! Entries being written or kept, and the best block (and hash of the coins) they bring the base view to.
+    mutable CCoinsMap mapPending;
+    uint256 hashPending;
+    MuHash3072 muhashPending;
+    //! Whether mapPending is being written. It is not modified while this is set.
+    bool fWriting;
+    //! Whether a background write failed. Reported by the next BatchWrite or Wait.
+    bool fFailed;
+    bool fQuit;
+
+    //! Memory used by mapPending. Until fUsageKnown is set, only that of the map itself.
+    mutable size_t nPendingUsage;
+    bool fUsageKnown;
+
+    //! Entries of the previous write, left for the writer thread to free.
+    CCoinsMap mapRelease;
+
+    std::thread thread;
+
+    void ThreadWriter();
+
+public:
+    CCoinsViewWriteBehind(CCoinsView* viewIn);
+    ~CCoinsViewWriteBehind();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    MuHash3072 GetMuHash() const override;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase = true) override;
+
+    /** Wait until the current write, if any, has reached the base view. Returns false if a write failed. */
+    bool Wait();
+
+    /**
+     * Memory used by the entries being written or kept (in bytes). Right after
+     * a BatchWrite this waits for the writer thread to add up the memory of
+     * the coins, which it does before writing them.
+     */
+    size_t DynamicMemoryUsage() const;
+};
+
+#endif // BITCOIN_COINSWRITEBEHIND_H
@@ -86,6 +86,13 @@ typedef int32_t ssize_t;
 size_t strnlen( const char *start, size_t max_len);
 #endif // HAVE_DECL_STRNLEN
 
+// Wait for single sockets with poll() rather than select(), which can't
+// handle sockets past FD_SETSIZE. Windows' WSAPoll is broken, so only on
+// platforms where poll() is known to work.
+#if defined(__linux__)
+#define USE_POLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #ifdef WIN32
     return true;
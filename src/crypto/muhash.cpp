@@ -0,0 +1,169 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/sha256.h>
+
+#include <limits>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+
+const limb_t MAX_LIMB = std::numeric_limits<limb_t>::max();
+
+/** Add v to the number in limbs, returning the carry out of the top limb. */
+limb_t AddSmall(limb_t* limbs, double_limb_t v)
+{
+    for (int i = 0; i < Num3072::LIMBS && v; ++i) {
+        v += limbs[i];
+        limbs[i] = (limb_t)v;
+        v >>= Num3072::LIMB_SIZE;
+    }
+    return (limb_t)v;
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = 0;
+        for (int j = sizeof(limb_t) - 1; j >= 0; --j) {
+            limbs[i] = (limbs[i] << 8) | data[i * sizeof(limb_t) + j];
+        }
+    }
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+void Num3072::FullReduce()
+{
+    // The number is below 2^3072, so it is at least the prime exactly when
+    // adding the difference between the two overflows.
+    if (limbs[0] <= MAX_LIMB - MAX_PRIME_DIFF) return;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != MAX_LIMB) return;
+    }
+    AddSmall(limbs, MAX_PRIME_DIFF);
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook multiplication into a double width product. a may alias
+    // this, so limbs is only written at the end.
+    limb_t tmp[2 * LIMBS];
+    for (int i = 0; i < LIMBS; ++i) {
+        tmp[i] = 0;
+    }
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            double_limb_t t = (double_limb_t)limbs[i] * a.limbs[j] + tmp[i + j] + carry;
+            tmp[i + j] = (limb_t)t;
+            carry = t >> LIMB_SIZE;
+        }
+        tmp[i + LIMBS] = carry;
+    }
+
+    // 2^3072 is congruent to MAX_PRIME_DIFF, so fold the upper half into the
+    // lower one, and then whatever still carries over.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t t = (double_limb_t)tmp[i + LIMBS] * MAX_PRIME_DIFF + tmp[i] + carry;
+        limbs[i] = (limb_t)t;
+        carry = t >> LIMB_SIZE;
+    }
+    while (carry) {
+        carry = AddSmall(limbs, (double_limb_t)carry * MAX_PRIME_DIFF);
+    }
+    FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // By Fermat's little theorem, the inverse is this to the power of p - 2,
+    // which is all ones in binary except for the lowest limb.
+    Num3072 out;
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        const limb_t exp = i == 0 ? MAX_LIMB - MAX_PRIME_DIFF - 1 : MAX_LIMB;
+        for (int j = LIMB_SIZE - 1; j >= 0; --j) {
+            out.Multiply(out);
+            if ((exp >> j) & 1) out.Multiply(*this);
+        }
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    Num3072 tmp(*this);
+    tmp.FullReduce();
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t limb = tmp.limbs[i];
+        for (size_t j = 0; j < sizeof(limb_t); ++j) {
+            out[i * sizeof(limb_t) + j] = (unsigned char)limb;
+            limb >>= 8;
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    // Expand the SHA256 of the element into 3072 bits with ChaCha20.
+    unsigned char key[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(key);
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    ChaCha20(key, sizeof(key)).Output(bytes, sizeof(bytes));
+    return Num3072(bytes);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    numerator.Divide(denominator);
+    denominator.SetToOne();
+    unsigned char data[Num3072::BYTE_SIZE];
+    numerator.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(hash);
+}
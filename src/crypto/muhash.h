@@ -0,0 +1,106 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** An integer modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+#if defined(__SIZEOF_INT128__)
+    typedef uint64_t limb_t;
+    typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const int LIMB_SIZE = 8 * sizeof(limb_t);
+    static const int LIMBS = 3072 / LIMB_SIZE;
+    static const size_t BYTE_SIZE = 384;
+    //! 2^3072 minus the modulus.
+    static const limb_t MAX_PRIME_DIFF = 1103717;
+
+    limb_t limbs[LIMBS];
+
+    Num3072() { SetToOne(); }
+    //! Interpret BYTE_SIZE little-endian bytes as a number (which must be below 2^3072).
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void SetToOne();
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    //! Write the number, reduced modulo the prime, as BYTE_SIZE little-endian bytes.
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    void FullReduce();
+    Num3072 GetInverse() const;
+};
+
+/**
+ * A hash of a multiset of byte strings, which can be updated incrementally.
+ *
+ * Every element is hashed to a number modulo a 3072-bit prime, and the
+ * multiset is represented by the product of the numbers of its elements. As
+ * multiplication is commutative, the result does not depend on the order in
+ * which elements are added; removing an element divides by its number. Sets
+ * can be combined with operator*= and operator/=, so a hash can be kept up to
+ * date by applying the changes to the set in batches.
+ *
+ * To avoid a costly modular inversion for every removal, the numerator and
+ * denominator are kept apart until Finalize() is called.
+ *
+ * The construction is described in "Incremental Multiset Hash Functions and
+ * Their Application to Memory Integrity Checking" by Clarke et al.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    /** Hash of the empty set. */
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Add, or take away, all elements of another set. */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** Compute the 32-byte hash of the set. This normalizes the internal state. */
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        numerator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+        denominator.ToBytes(data);
+        s.write((const char*)data, sizeof(data));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char data[Num3072::BYTE_SIZE];
+        s.read((char*)data, sizeof(data));
+        numerator = Num3072(data);
+        s.read((char*)data, sizeof(data));
+        denominator = Num3072(data);
+    }
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
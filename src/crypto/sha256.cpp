@@ -19,6 +19,21 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 #endif
 #endif
 
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+}
+
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -144,6 +159,47 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
 } // namespace sha256
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+
+/** Compute the double-SHA256 of one 64-byte input using a single-block transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    WriteBE32(buffer2 + 0, s[0]);
+    WriteBE32(buffer2 + 4, s[1]);
+    WriteBE32(buffer2 + 8, s[2]);
+    WriteBE32(buffer2 + 12, s[3]);
+    WriteBE32(buffer2 + 16, s[4]);
+    WriteBE32(buffer2 + 20, s[5]);
+    WriteBE32(buffer2 + 24, s[6]);
+    WriteBE32(buffer2 + 28, s[7]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    WriteBE32(out + 0, s[0]);
+    WriteBE32(out + 4, s[1]);
+    WriteBE32(out + 8, s[2]);
+    WriteBE32(out + 12, s[3]);
+    WriteBE32(out + 16, s[4]);
+    WriteBE32(out + 20, s[5]);
+    WriteBE32(out + 24, s[6]);
+    WriteBE32(out + 28, s[7]);
+}
 
 bool SelfTest(TransformType tr) {
     static const unsigned char in1[65] = {0, 0x80};
@@ -172,23 +228,107 @@ bool SelfTest(TransformType tr) {
     return true;
 }
 
+bool SelfTestD64(TransformD64Type tr, size_t ways) {
+    // The double-SHA256 of the 64-byte inputs {i, i, ..., i} for i = 0..7.
+    static const unsigned char out[8][32] = {
+        {0xe2, 0xf6, 0x1c, 0x3f, 0x71, 0xd1, 0xde, 0xfd, 0x3f, 0xa9, 0x99, 0xdf, 0xa3, 0x69, 0x53, 0x75, 0x5c, 0x69, 0x06, 0x89, 0x79, 0x99, 0x62, 0xb4, 0x8b, 0xeb, 0xd8, 0x36, 0x97, 0x4e, 0x8c, 0xf9},
+        {0x61, 0xa0, 0x88, 0xb4, 0xcf, 0x1f, 0x24, 0x4e, 0x52, 0xe5, 0xe8, 0x8f, 0xcd, 0x91, 0xb3, 0xb7, 0xd6, 0x13, 0x5e, 0xbf, 0xf5, 0x34, 0x76, 0xec, 0xc8, 0x43, 0x6e, 0x23, 0xb5, 0xe7, 0xf0, 0x95},
+        {0x99, 0x2e, 0x80, 0x14, 0x53, 0xaf, 0x89, 0x3c, 0x1b, 0x68, 0x7d, 0x0b, 0xa6, 0xfa, 0x42, 0x93, 0xe3, 0x88, 0xee, 0x71, 0x07, 0x93, 0xe6, 0x56, 0x4a, 0xcf, 0xf4, 0x30, 0xc6, 0x32, 0x29, 0x1d},
+        {0x64, 0x3d, 0x4b, 0x7e, 0x36, 0x99, 0xd2, 0xb3, 0xd8, 0xc9, 0x37, 0x4b, 0x36, 0x00, 0xbd, 0xf1, 0xf5, 0x73, 0xb7, 0x99, 0xd2, 0xa5, 0x68, 0x86, 0x23, 0x65, 0x51, 0xa0, 0x16, 0xb4, 0x2d, 0xdf},
+        {0xc2, 0x54, 0xa5, 0x10, 0x82, 0x30, 0xae, 0x23, 0xb1, 0x5c, 0x40, 0x23, 0xfb, 0xbf, 0x61, 0xbf, 0xff, 0xba, 0xb7, 0xbb, 0x5b, 0x06, 0x85, 0x2c, 0xf6, 0x06, 0xed, 0xdb, 0xc6, 0xa4, 0x4a, 0xbb},
+        {0xe3, 0x74, 0xe0, 0x98, 0x8d, 0xe6, 0xa3, 0xb0, 0x5c, 0x55, 0x03, 0x91, 0xa7, 0xa4, 0x66, 0x71, 0x9b, 0x37, 0xc6, 0x92, 0xcf, 0x4d, 0x95, 0x45, 0xb3, 0x37, 0xd4, 0xdf, 0x7d, 0x4e, 0xf0, 0xf7},
+        {0xa0, 0xec, 0xa9, 0xbd, 0xd9, 0xdc, 0x6c, 0x42, 0xda, 0xd3, 0x9c, 0x56, 0xf4, 0xb5, 0x62, 0x7b, 0x2a, 0x09, 0x5a, 0x8f, 0x14, 0xce, 0xe7, 0x6f, 0x1b, 0x67, 0x64, 0x8d, 0x0e, 0x78, 0x52, 0x50},
+        {0xa6, 0x5b, 0x17, 0xa2, 0x7c, 0x83, 0xcc, 0x5f, 0xa4, 0x54, 0x6a, 0xb0, 0xbf, 0x91, 0xbb, 0xd9, 0xdf, 0xe3, 0x27, 0xc0, 0x12, 0xf6, 0x25, 0xb0, 0xd6, 0xf0, 0x6d, 0xf2, 0x36, 0x74, 0x34, 0x39}
+    };
+    unsigned char in[64 * 8];
+    unsigned char buf[32 * 8];
+    for (size_t i = 0; i < 8; ++i) {
+        memset(in + 64 * i, (int)i, 64);
+    }
+    for (size_t i = 0; i + ways <= 8; i += ways) {
+        tr(buf, in + 64 * i);
+        if (memcmp(buf, out[i], 32 * ways)) return false;
+    }
+    return true;
+}
+
 TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__)) && defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
 
 } // namespace
 
 std::string SHA256AutoDetect()
 {
+    std::string ret = "standard";
 #if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__))
     uint32_t eax, ebx, ecx, edx;
-    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx >> 19) & 1) {
+    bool have_sse4 = false;
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    bool have_avx2 = false;
+#endif
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+    bool have_shani = false;
+#endif
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        have_sse4 = (ecx >> 19) & 1;
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+        bool have_xsave = (ecx >> 27) & 1;
+        bool have_avx = (ecx >> 28) & 1;
+        bool enabled_avx = have_xsave && have_avx && AVXEnabled();
+#endif
+        if (have_sse4 && __get_cpuid_max(0, nullptr) >= 7) {
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+            have_avx2 = enabled_avx && ((ebx >> 5) & 1);
+#endif
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+            have_shani = (ebx >> 29) & 1;
+#endif
+        }
+    }
+
+    if (have_sse4) {
         Transform = sha256_sse4::Transform;
-        assert(SelfTest(Transform));
-        return "sse4";
+        TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        ret = "sse4(1way)";
+#if defined(ENABLE_SHANI) && !defined(BUILD_BITCOIN_INTERNAL)
+        if (have_shani) {
+            Transform = sha256_shani::Transform;
+            TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+            ret = "shani(1way)";
+        }
+#endif
+#if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret += ",sse41(4way)";
+#endif
+    }
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
     }
+#endif
 #endif
 
     assert(SelfTest(Transform));
-    return "standard";
+    assert(SelfTestD64(TransformD64, 1));
+    if (TransformD64_4way) assert(SelfTestD64(TransformD64_4way, 4));
+    if (TransformD64_8way) assert(SelfTestD64(TransformD64_8way, 8));
+    return ret;
 }
 
 ////// SHA-256
@@ -247,3 +387,29 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
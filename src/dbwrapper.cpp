@@ -188,6 +188,17 @@ bool CDBWrapper::IsEmpty()
 }
 
 CDBIterator::~CDBIterator() { delete piter; }
+
+CDBSnapshot::CDBSnapshot(const CDBWrapper &_parent) : parent(_parent), psnapshot(_parent.pdb->GetSnapshot()) {}
+
+CDBSnapshot::~CDBSnapshot() { parent.pdb->ReleaseSnapshot(psnapshot); }
+
+CDBIterator *CDBSnapshot::NewIterator() const
+{
+    leveldb::ReadOptions iteroptions = parent.iteroptions;
+    iteroptions.snapshot = psnapshot;
+    return new CDBIterator(parent, parent.pdb->NewIterator(iteroptions));
+}
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
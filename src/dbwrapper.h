@@ -176,6 +176,7 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be nullptr in case of default environment)
     leveldb::Env* penv;
@@ -340,4 +341,25 @@ public:
 
 };
 
+/**
+ * A consistent view of a CDBWrapper as of the time it was taken, which later
+ * writes do not affect. Iterators on it can be used from several threads at
+ * once, to read different parts of the same state of the database.
+ */
+class CDBSnapshot
+{
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *psnapshot;
+
+public:
+    explicit CDBSnapshot(const CDBWrapper &_parent);
+    ~CDBSnapshot();
+
+    CDBSnapshot(const CDBSnapshot&) = delete;
+    CDBSnapshot& operator=(const CDBSnapshot&) = delete;
+
+    CDBIterator *NewIterator() const;
+};
+
 #endif // BITCOIN_DBWRAPPER_H
@@ -14,6 +14,12 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
+#include <blockcache.h>
+#include <blockimport.h>
+#include <blockpipeline.h>
+#include <blockreadpool.h>
+#include <coinsprefetch.h>
+#include <coinswritebehind.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <fs.h>
@@ -193,8 +199,14 @@ void Shutdown()
 
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
+    if (g_blocktemplateupdater) {
+        UnregisterValidationInterface(g_blocktemplateupdater.get());
+        g_blocktemplateupdater.reset();
+    }
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
     if (g_connman) g_connman->Stop();
+    // Reads still queued send to peers, so let them finish before the connection manager goes away.
+    g_blockreadpool.reset();
     peerLogic.reset();
     g_connman.reset();
 
@@ -235,7 +247,10 @@ void Shutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        pblockpipeline.reset();
         pcoinsTip.reset();
+        pcoinswritebehind.reset();
+        pcoinsprefetch.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
@@ -262,6 +277,7 @@ void Shutdown()
     UnregisterAllValidationInterfaces();
     GetMainSignals().UnregisterBackgroundSignalScheduler();
     GetMainSignals().UnregisterWithMempoolSignals(mempool);
+    g_blockcache.reset();
 #ifdef ENABLE_WALLET
     CloseWallets();
 #endif
@@ -323,10 +339,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blockcache=<n>", strprintf(_("Keep up to <n> megabytes of recently connected or requested blocks in memory (0 to disable, default: %d)"), DEFAULT_BLOCK_CACHE));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
+    strUsage += HelpMessageOpt("-assumeutxo=<hex>", _("Hash of the UTXO set snapshot to load with -loadtxoutset, as reported in hash_serialized_2 by gettxoutsetinfo on a node you trust at the snapshot's block"));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write periodic and cache size triggered flushes of the UTXO cache to disk in the background (default: %u)"), DEFAULT_ASYNC_FLUSH));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), BITCOIN_CONF_FILENAME));
     if (mode == HMM_BITCOIND)
     {
@@ -342,9 +361,11 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Load the chain state from a UTXO set snapshot written by dumptxoutset on startup, if the chain state is empty. The blocks up to the snapshot are trusted and never validated"));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
+    strUsage += HelpMessageOpt("-muhash", strprintf(_("Keep a rolling hash of the UTXO set up to date with every block, for gettxoutsetinfo \"muhash\" (default: %u)"), DEFAULT_MUHASH));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
     if (showDebug) {
         strUsage += HelpMessageOpt("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()));
@@ -353,14 +374,21 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-parpin", strprintf("Pin every script verification thread to a core of its own, where supported (default: %u)", DEFAULT_SCRIPTCHECK_PIN));
+    }
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prefetchblocks=<n>", strprintf(_("Load the inputs of up to <n> blocks ahead of the tip in the background while connecting blocks (0 to %d, default: %d)"), MAX_PREFETCH_BLOCKS, DEFAULT_PREFETCH_BLOCKS));
+    strUsage += HelpMessageOpt("-pipelineblocks=<n>", strprintf(_("Read and check up to <n> blocks ahead of the tip in the background while connecting blocks (0 to %d, default: %d)"), MAX_PIPELINE_BLOCKS, DEFAULT_PIPELINE_BLOCKS));
     strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
+    strUsage += HelpMessageOpt("-reindexthreads=<n>", strprintf(_("Set the number of threads reading and checking blocks for -reindex (%u to %d, 0 = auto, <0 = leave that many cores free, 1 = one thread, default: %d)"),
+        -GetNumCores(), MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
@@ -370,6 +398,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), DEFAULT_BANSCORE_THRESHOLD));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), DEFAULT_MISBEHAVING_BANTIME));
+    strUsage += HelpMessageOpt("-blockreadthreads=<n>", strprintf(_("Set the number of threads reading blocks from disk for peers, RPC and REST (0 to %d, 0 = read them on the requesting thread, default: %d)"), MAX_BLOCK_READ_THREADS, DEFAULT_BLOCK_READ_THREADS));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s); -connect=0 disables automatic connections (the rules for this peer are the same as for -addnode)"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
@@ -383,6 +412,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandlerthreads=<n>", strprintf(_("Set the number of threads processing messages from peers, each handling its share of the peers (1 to %d, default: %d)"), MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -391,6 +421,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    if (showDebug)
+        strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf("How to wait for sockets to become ready: select, or epoll where supported (default: %s)", DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -621,17 +653,26 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
+        int nReindexThreads = gArgs.GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS);
+        if (nReindexThreads <= 0)
+            nReindexThreads += GetNumCores();
+        nReindexThreads = std::min(nReindexThreads, MAX_REINDEX_THREADS);
+        if (nReindexThreads > 1) {
+            LogPrintf("Reindexing block files using %d threads\n", nReindexThreads);
+            LoadBlockFilesParallel(chainparams, nReindexThreads);
+        } else {
+            int nFile = 0;
+            while (true) {
+                CDiskBlockPos pos(nFile, 0);
+                if (!fs::exists(GetBlockPosFilename(pos, "blk")))
+                    break; // No block files left to reindex
+                FILE *file = OpenBlockFile(pos, true);
+                if (!file)
+                    break; // This error is logged in OpenBlockFile
+                LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+                LoadExternalBlockFile(chainparams, file, &pos);
+                nFile++;
+            }
         }
         pblocktree->WriteReindexing(false);
         fReindex = false;
@@ -816,6 +857,8 @@ namespace { // Variables internal to initialization process only
 int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
+// Whether the socket handler waits for sockets with epoll rather than select()
+bool fUseEpoll = false;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
 
 } // namespace
@@ -905,8 +948,27 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    const std::string strSocketEvents = gArgs.GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (strSocketEvents == "epoll") {
+#ifdef HAVE_EPOLL
+        fUseEpoll = true;
+#else
+        return InitError(_("-socketevents=epoll is not supported on this platform."));
+#endif
+    } else if (strSocketEvents != "select") {
+        return InitError(strprintf(_("Unknown socket events mode -socketevents=%s (use select or epoll)."), strSocketEvents));
+    }
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    // (select() can't wait for sockets past FD_SETSIZE; epoll can, and
+    // netbase then waits for single sockets with poll())
+    bool fSelectableOnly = !fUseEpoll;
+#ifndef USE_POLL
+    fSelectableOnly = true;
+#endif
+    if (fSelectableOnly) {
+        nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
+    }
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return InitError(_("Not enough file descriptors available."));
@@ -968,7 +1030,13 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
+
+    if (gArgs.IsArgSet("-loadtxoutset") && gArgs.GetBoolArg("-reindex", false))
+        return InitError(_("-loadtxoutset is incompatible with -reindex."));
+    if (gArgs.IsArgSet("-assumeutxo") && !IsHex(gArgs.GetArg("-assumeutxo", "")))
+        return InitError(strprintf(_("Invalid hash for -assumeutxo: '%s'"), gArgs.GetArg("-assumeutxo", "")));
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fMuHash = gArgs.GetBoolArg("-muhash", DEFAULT_MUHASH);
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1014,6 +1082,8 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    nPrefetchBlocks = std::max(0, std::min(MAX_PREFETCH_BLOCKS, (int)gArgs.GetArg("-prefetchblocks", DEFAULT_PREFETCH_BLOCKS)));
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = gArgs.GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1228,8 +1298,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
+        // Leave the first core for the thread that hands out the work.
+        const bool fPin = gArgs.GetBoolArg("-parpin", DEFAULT_SCRIPTCHECK_PIN);
         for (int i=0; i<nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(boost::bind(&ThreadScriptCheck, fPin ? i + 1 : -1));
     }
 
     // Start the lightweight task scheduler thread
@@ -1279,6 +1351,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     peerLogic.reset(new PeerLogicValidation(&connman, scheduler));
     RegisterValidationInterface(peerLogic.get());
 
+    int nBlockReadThreads = std::max(0, std::min(MAX_BLOCK_READ_THREADS, (int)gArgs.GetArg("-blockreadthreads", DEFAULT_BLOCK_READ_THREADS)));
+    if (nBlockReadThreads > 0) {
+        LogPrintf("Using %d threads to read blocks for peers\n", nBlockReadThreads);
+        g_blockreadpool.reset(new CBlockReadPool(nBlockReadThreads));
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string& cmt : gArgs.GetArgs("-uacomment")) {
@@ -1400,6 +1478,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nBlockCache = std::max((int64_t)0, gArgs.GetArg("-blockcache", DEFAULT_BLOCK_CACHE)) << 20;
+    if (nBlockCache > 0) {
+        LogPrintf("* Using %.1fMiB for recently used blocks\n", nBlockCache * (1.0 / 1024 / 1024));
+        g_blockcache.reset(new CBlockCache(nBlockCache));
+    }
 
     bool fLoaded = false;
     while (!fLoaded && !fRequestShutdown) {
@@ -1411,8 +1494,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         nStart = GetTimeMillis();
         do {
             try {
+                pblockpipeline.reset();
                 UnloadBlockIndex();
                 pcoinsTip.reset();
+                pcoinswritebehind.reset();
+                pcoinsprefetch.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
                 pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
@@ -1466,7 +1552,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 // At this point we're either in reindex or we've loaded a useful
                 // block tree into mapBlockIndex!
 
-                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState));
+                pcoinsdbview.reset(new CCoinsViewDB(nCoinDBCache, false, fReset || fReindexChainState, fMuHash));
                 pcoinscatcher.reset(new CCoinsViewErrorCatcher(pcoinsdbview.get()));
 
                 // If necessary, upgrade from older database format.
@@ -1482,10 +1568,44 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // With -muhash, the hash of the UTXO set is kept up to date from here on.
+                if (!pcoinsdbview->InitMuHash()) {
+                    strLoadError = _("Error computing the UTXO set hash");
+                    break;
+                }
+
+                // A chainstate that is empty, or only has the genesis block, can be
+                // loaded from a snapshot.
+                bool fLoadedSnapshot = false;
+                if (gArgs.IsArgSet("-loadtxoutset")) {
+                    uint256 hashBestBlock = pcoinsdbview->GetBestBlock();
+                    if (hashBestBlock.IsNull() || hashBestBlock == chainparams.GetConsensus().hashGenesisBlock) {
+                        uiInterface.InitMessage(_("Loading UTXO set snapshot..."));
+                        fs::path snapshot_path = fs::absolute(gArgs.GetArg("-loadtxoutset", ""), GetDataDir());
+                        if (!LoadTxOutSetSnapshot(snapshot_path, uint256S(gArgs.GetArg("-assumeutxo", "")), chainparams)) {
+                            strLoadError = _("Unable to load the UTXO set snapshot");
+                            break;
+                        }
+                        fLoadedSnapshot = true;
+                    } else {
+                        LogPrintf("Chain state is not empty, ignoring -loadtxoutset\n");
+                    }
+                }
+
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsprefetch.reset(new CCoinsViewPrefetch(pcoinscatcher.get(), chainparams.GetConsensus()));
+                int nPipelineBlocks = std::max(0, std::min(MAX_PIPELINE_BLOCKS, (int)gArgs.GetArg("-pipelineblocks", DEFAULT_PIPELINE_BLOCKS)));
+                if (nPipelineBlocks > 0) {
+                    pblockpipeline.reset(new CBlockPipeline(chainparams.GetConsensus(), chainparams.MessageStart(), nPipelineBlocks));
+                }
+                if (gArgs.GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH)) {
+                    pcoinswritebehind.reset(new CCoinsViewWriteBehind(pcoinsprefetch.get()));
+                    pcoinsTip.reset(new CCoinsViewCache(pcoinswritebehind.get()));
+                } else {
+                    pcoinsTip.reset(new CCoinsViewCache(pcoinsprefetch.get()));
+                }
 
-                bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
+                bool is_coinsview_empty = !fLoadedSnapshot && (fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull());
                 if (!is_coinsview_empty) {
                     // LoadChainTip sets chainActive based on pcoinsTip's best block
                     if (!LoadChainTip(chainparams)) {
@@ -1600,6 +1720,14 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         }
     }
 
+    // A chain state loaded from a UTXO set snapshot has none of the blocks up
+    // to the snapshot, and they are not validated, so don't offer them.
+    if (GetSnapshotBase()) {
+        LogPrintf("Unsetting NODE_NETWORK, the chain state was loaded from an unvalidated UTXO set snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+        SetMiscWarning(_("Warning: the chain state was loaded from a UTXO set snapshot, the blocks up to it are not validated"));
+    }
+
     if (chainparams.GetConsensus().vDeployments[Consensus::DEPLOYMENT_SEGWIT].nTimeout != 0) {
         // Only advertise witness capabilities if they have a reasonable start time.
         // This allows us to have the code merged without a defined softfork, by setting its
@@ -1672,6 +1800,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.m_msgproc = peerLogic.get();
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMessageHandlerThreads = gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
+    connOptions.m_use_epoll = fUseEpoll;
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
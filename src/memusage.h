@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <support/allocators/pool.h>
 
 #include <stdlib.h>
 
@@ -164,6 +165,31 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t PoolBucketUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // Large bucket arrays are not pooled.
+    return sizeof(void*) * m.bucket_count() > MAX_BLOCK_SIZE_BYTES ? MallocUsage(sizeof(void*) * m.bucket_count()) : 0;
+}
+
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // Nodes come from the pool, which keeps the memory of erased nodes for
+    // reuse rather than returning it, so all of its chunks count.
+    return m.get_allocator().resource()->BytesAllocated() + PoolBucketUsage(m);
+}
+
+/**
+ * The part of DynamicUsage(m) taken by what is in the map now. Pool memory
+ * of erased nodes, which new ones will reuse before the pool grows, is left
+ * out.
+ */
+template<typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t InUseDynamicUsage(const std::unordered_map<X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    return m.get_allocator().resource()->BytesInUse() + PoolBucketUsage(m);
+}
 }
 
 #endif // BITCOIN_MEMUSAGE_H
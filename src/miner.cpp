@@ -27,6 +27,7 @@
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <chrono>
 #include <queue>
 #include <utility>
 
@@ -103,6 +104,7 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    lastPackageFeeRate = CFeeRate();
 }
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
@@ -433,6 +435,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         ++nPackagesSelected;
+        lastPackageFeeRate = CFeeRate(packageFees, packageSize);
 
         // Update transactions that depend on each of these
         nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
@@ -457,3 +460,345 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+std::unique_ptr<BlockTemplateUpdater> g_blocktemplateupdater;
+
+BlockTemplateUpdater::BlockTemplateUpdater(const CChainParams& params) :
+    chainparams(params), fQuit(false), fRebuild(true), fActive(true), nLastPoll(GetTime()), fPolled(false), fWake(false), fBusy(false),
+    pindexPublished(nullptr), nTransactionsUpdatedPublished(0), fPublishedFinal(false),
+    pindexPrev(nullptr), nBlockWeight(0), nBlockSigOpsCost(0), nFees(0), nHeight(0), nLockTimeCutoff(0),
+    fIncludeWitness(false), fMissingTxs(false), fOutranked(false), nLastRebuild(0)
+{
+    const BlockAssembler::Options options = DefaultOptions(params);
+    // Same limits as BlockAssembler uses
+    nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    blockMinFeeRate = options.blockMinFeeRate;
+    thread = std::thread(&TraceThread<std::function<void()> >, "blktemplate", std::function<void()>(std::bind(&BlockTemplateUpdater::ThreadUpdate, this)));
+}
+
+BlockTemplateUpdater::~BlockTemplateUpdater()
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        fQuit = true;
+    }
+    cond.notify_all();
+    condIdle.notify_all();
+    thread.join();
+}
+
+std::shared_ptr<const CBlockTemplate> BlockTemplateUpdater::GetBlockTemplate(const CBlockIndex* pindex, unsigned int& nTransactionsUpdated)
+{
+    AssertLockHeld(cs_main);
+
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        nLastPoll = GetTime();
+        if (!fActive) {
+            // Nothing was kept up to date while nobody asked.
+            fActive = true;
+            fRebuild = true;
+            cond.notify_one();
+            return nullptr;
+        }
+        if (!fPolled) {
+            // The update thread may be holding back a rebuild for a caller.
+            fPolled = true;
+            fWake = true;
+            cond.notify_one();
+        }
+        if (!published || pindexPublished != pindex || pindex != chainActive.Tip()) return nullptr;
+        nTransactionsUpdated = nTransactionsUpdatedPublished;
+        if (fPublishedFinal) return published;
+        ptemplate = published;
+    }
+
+    // The coinbase of a template changed in the background is only brought
+    // up to date, and the template checked, once it is handed out.
+    std::shared_ptr<CBlockTemplate> pfinal = std::make_shared<CBlockTemplate>(*ptemplate);
+    UpdateCoinbase(*pfinal, pindex);
+    CValidationState state;
+    const bool fValid = TestBlockValidity(state, chainparams, pfinal->block, chainActive.Tip(), false, false);
+    if (!fValid) {
+        LogPrintf("%s: updated template is invalid (%s), assembling it anew\n", __func__, FormatStateMessage(state));
+    }
+
+    std::lock_guard<std::mutex> lock(cs);
+    if (published == ptemplate) {
+        if (fValid) {
+            published = pfinal;
+            fPublishedFinal = true;
+        } else {
+            published.reset();
+            fRebuild = true;
+            cond.notify_one();
+        }
+    }
+    if (!fValid) return nullptr;
+    return pfinal;
+}
+
+void BlockTemplateUpdater::SyncWithUpdates()
+{
+    std::unique_lock<std::mutex> lock(cs);
+    condIdle.wait(lock, [this]{ return fQuit || (!fBusy && !fRebuild && !fWake && vQueued.empty()); });
+}
+
+bool BlockTemplateUpdater::KeepUpdating()
+{
+    if (fActive && GetTime() > nLastPoll + BLOCK_TEMPLATE_IDLE_TIMEOUT) {
+        // Nobody asked for a template in a while: stop following the mempool
+        // and the tip until somebody does again.
+        fActive = false;
+        fRebuild = false;
+        vQueued.clear();
+        published.reset();
+        LogPrint(BCLog::BENCH, "BlockTemplateUpdater: no template asked for in %d seconds, pausing\n", BLOCK_TEMPLATE_IDLE_TIMEOUT);
+    }
+    return fActive;
+}
+
+void BlockTemplateUpdater::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!KeepUpdating()) return;
+        vQueued.emplace_back(ptx, true);
+    }
+    cond.notify_one();
+}
+
+void BlockTemplateUpdater::TransactionRemovedFromMempool(const CTransactionRef& ptx)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!KeepUpdating()) return;
+        vQueued.emplace_back(ptx, false);
+    }
+    cond.notify_one();
+}
+
+void BlockTemplateUpdater::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (!KeepUpdating()) return;
+        fRebuild = true;
+        // Whatever happened to the mempool before is part of the new template.
+        vQueued.clear();
+    }
+    cond.notify_one();
+}
+
+void BlockTemplateUpdater::Rebuild()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    pblocktemplate.reset();
+    setInBlock.clear();
+    pindexPrev = chainActive.Tip();
+    nLastRebuild = GetTime();
+    fMissingTxs = false;
+    fOutranked = false;
+
+    CScript scriptDummy = CScript() << OP_TRUE;
+    BlockAssembler assembler(chainparams);
+    try {
+        pblocktemplate = assembler.CreateNewBlock(scriptDummy, true);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return;
+    }
+
+    const CBlock& block = pblocktemplate->block;
+    nHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                       ? pindexPrev->GetMedianTimePast()
+                       : block.GetBlockTime();
+    fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
+    // Reserve space for the coinbase as BlockAssembler does
+    nBlockWeight = 4000;
+    nBlockSigOpsCost = 400;
+    nFees = -pblocktemplate->vTxFees[0];
+    tailFeeRate = block.vtx.size() > 1 ? assembler.GetLastPackageFeeRate() : CFeeRate(MAX_MONEY);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        setInBlock.insert(block.vtx[i]->GetHash());
+        nBlockWeight += GetTransactionWeight(*block.vtx[i]);
+        nBlockSigOpsCost += pblocktemplate->vTxSigOpsCost[i];
+    }
+}
+
+bool BlockTemplateUpdater::AddTransaction(CTxMemPool::txiter it)
+{
+    AssertLockHeld(mempool.cs);
+
+    const CTransaction& tx = it->GetTx();
+    if (setInBlock.count(tx.GetHash())) return false;
+    // The selection in BlockAssembler would have left this out as well.
+    if (it->GetModifiedFee() < blockMinFeeRate.GetFee(it->GetTxSize())) return false;
+    if (!IsFinalTx(tx, nHeight, nLockTimeCutoff) || (!fIncludeWitness && tx.HasWitness())) return false;
+
+    for (const CTxMemPoolEntry* parent : mempool.GetMemPoolParents(it)) {
+        if (!setInBlock.count(parent->GetTx().GetHash())) {
+            fMissingTxs = true;
+            return false;
+        }
+    }
+    if (nBlockWeight + WITNESS_SCALE_FACTOR * it->GetTxSize() >= nBlockMaxWeight ||
+        nBlockSigOpsCost + it->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST) {
+        fMissingTxs = true;
+        return false;
+    }
+    // With all its parents in the template the transaction is a package of
+    // its own, which BlockAssembler would have placed before any package
+    // with a lower feerate.
+    const CFeeRate feeRate(it->GetModifiedFee(), it->GetTxSize());
+    if (feeRate > tailFeeRate) {
+        fMissingTxs = true;
+        fOutranked = true;
+        return false;
+    }
+
+    pblocktemplate->block.vtx.emplace_back(it->GetSharedTx());
+    pblocktemplate->vTxFees.push_back(it->GetFee());
+    pblocktemplate->vTxSigOpsCost.push_back(it->GetSigOpCost());
+    nBlockWeight += it->GetTxWeight();
+    nBlockSigOpsCost += it->GetSigOpCost();
+    nFees += it->GetFee();
+    setInBlock.insert(tx.GetHash());
+    tailFeeRate = feeRate;
+    return true;
+}
+
+bool BlockTemplateUpdater::RemoveTransactions(const std::set<uint256>& hashes)
+{
+    std::vector<CTransactionRef>& vtx = pblocktemplate->block.vtx;
+    std::set<uint256> setRemoved;
+    size_t nKept = 1;
+    for (size_t i = 1; i < vtx.size(); i++) {
+        // Parents come first, so anything spending a removed transaction is seen after it.
+        bool fRemove = hashes.count(vtx[i]->GetHash());
+        for (size_t j = 0; !fRemove && j < vtx[i]->vin.size(); j++) {
+            fRemove = setRemoved.count(vtx[i]->vin[j].prevout.hash);
+        }
+        if (fRemove) {
+            setRemoved.insert(vtx[i]->GetHash());
+            setInBlock.erase(vtx[i]->GetHash());
+            nBlockWeight -= GetTransactionWeight(*vtx[i]);
+            nBlockSigOpsCost -= pblocktemplate->vTxSigOpsCost[i];
+            nFees -= pblocktemplate->vTxFees[i];
+            continue;
+        }
+        vtx[nKept] = std::move(vtx[i]);
+        pblocktemplate->vTxFees[nKept] = pblocktemplate->vTxFees[i];
+        pblocktemplate->vTxSigOpsCost[nKept] = pblocktemplate->vTxSigOpsCost[i];
+        nKept++;
+    }
+    vtx.resize(nKept);
+    pblocktemplate->vTxFees.resize(nKept);
+    pblocktemplate->vTxSigOpsCost.resize(nKept);
+    return !setRemoved.empty();
+}
+
+void BlockTemplateUpdater::UpdateCoinbase(CBlockTemplate& blocktemplate, const CBlockIndex* pindex) const
+{
+    CBlock& block = blocktemplate.block;
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    // The witness commitment is always the last output of our coinbase.
+    if (!blocktemplate.vchCoinbaseCommitment.empty()) {
+        coinbaseTx.vout.pop_back();
+    }
+    coinbaseTx.vin[0].scriptWitness.SetNull();
+    coinbaseTx.vout[0].nValue = -blocktemplate.vTxFees[0] + GetBlockSubsidy(pindex->nHeight + 1, chainparams.GetConsensus());
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    blocktemplate.vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindex, chainparams.GetConsensus());
+}
+
+void BlockTemplateUpdater::ThreadUpdate()
+{
+    while (true) {
+        std::vector<std::pair<CTransactionRef, bool>> vChanges;
+        bool fRebuildNow;
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            while (!fQuit && !fRebuild && !fWake && vQueued.empty()) {
+                // Nobody is asking for templates, so there is no point in
+                // rebuilding for the transactions that were left out.
+                const bool fWaitForPoll = !fMissingTxs || !fPolled;
+                const int64_t nWait = nLastRebuild + BLOCK_TEMPLATE_REBUILD_INTERVAL - GetTime();
+                if (!fWaitForPoll && (fOutranked || nWait <= 0)) break;
+                fBusy = false;
+                condIdle.notify_all();
+                if (fWaitForPoll) {
+                    cond.wait(lock);
+                } else {
+                    cond.wait_for(lock, std::chrono::seconds(nWait));
+                }
+            }
+            if (fQuit) return;
+            fBusy = true;
+            fWake = false;
+            fRebuildNow = fRebuild || (fMissingTxs && fPolled && (fOutranked || GetTime() >= nLastRebuild + BLOCK_TEMPLATE_REBUILD_INTERVAL));
+            if (fRebuildNow) fPolled = false;
+            fRebuild = false;
+            vChanges.swap(vQueued);
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        bool fRebuilt = false;
+        {
+            LOCK(cs_main);
+            if (fRebuildNow || !pblocktemplate || pindexPrev != chainActive.Tip()) {
+                LOCK(mempool.cs);
+                Rebuild();
+                fRebuilt = true;
+            }
+        }
+        if (fRebuilt) {
+            if (!pblocktemplate) {
+                std::lock_guard<std::mutex> lock(cs);
+                published.reset();
+                continue;
+            }
+            LogPrint(BCLog::BENCH, "BlockTemplateUpdater: rebuilt template with %u txs: %.2fms\n", pblocktemplate->block.vtx.size() - 1, 0.001 * (GetTimeMicros() - nTimeStart));
+        } else {
+            // A tip change is notified as well and causes a rebuild, so only
+            // the mempool is needed here.
+            LOCK(mempool.cs);
+            bool fChanged = false;
+            std::set<uint256> setRemove;
+            for (size_t i = 0; i <= vChanges.size(); i++) {
+                // Removals are applied in batches, as they may scan the whole template.
+                if (!setRemove.empty() && (i == vChanges.size() || vChanges[i].second)) {
+                    fChanged |= RemoveTransactions(setRemove);
+                    setRemove.clear();
+                    // Room may have been made for transactions that were left out.
+                    if (mempool.size() > setInBlock.size()) fMissingTxs = true;
+                }
+                if (i == vChanges.size()) break;
+                if (vChanges[i].second) {
+                    CTxMemPool::txiter it = mempool.mapTx.find(vChanges[i].first->GetHash());
+                    if (it != mempool.mapTx.end()) fChanged |= AddTransaction(it);
+                } else {
+                    setRemove.insert(vChanges[i].first->GetHash());
+                }
+            }
+            if (!fChanged) continue;
+            // The coinbase follows once the template is handed out.
+            pblocktemplate->vTxFees[0] = -nFees;
+            LogPrint(BCLog::BENCH, "BlockTemplateUpdater: applied %u mempool changes, %u txs: %.2fms\n", vChanges.size(), pblocktemplate->block.vtx.size() - 1, 0.001 * (GetTimeMicros() - nTimeStart));
+        }
+
+        std::shared_ptr<const CBlockTemplate> pnew = std::make_shared<const CBlockTemplate>(*pblocktemplate);
+        const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+        std::lock_guard<std::mutex> lock(cs);
+        // The template is of no use once nobody asks for it anymore.
+        if (!fActive) continue;
+        published = std::move(pnew);
+        pindexPublished = pindexPrev;
+        fPublishedFinal = fRebuilt;
+        nTransactionsUpdatedPublished = nTransactionsUpdated;
+    }
+}
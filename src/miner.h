@@ -6,11 +6,16 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include <policy/feerate.h>
 #include <primitives/block.h>
 #include <txmempool.h>
+#include <validationinterface.h>
 
 #include <stdint.h>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 
@@ -21,6 +26,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Minimum seconds between rebuilds of the maintained block template for transactions that did not fit */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 5;
+/** Seconds without getblocktemplate calls after which the maintained block template is no longer kept up to date */
+static const int64_t BLOCK_TEMPLATE_IDLE_TIMEOUT = 60;
 
 struct CBlockTemplate
 {
@@ -148,6 +157,7 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    CFeeRate lastPackageFeeRate;
 
     // Chain context for the block
     int nHeight;
@@ -167,6 +177,9 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
 
+    /** Ancestor feerate of the last package added by CreateNewBlock, zero if none was */
+    CFeeRate GetLastPackageFeeRate() const { return lastPackageFeeRate; }
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
@@ -201,6 +214,108 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps a block template on the current tip up to date in the background, so
+ * that getblocktemplate doesn't have to assemble one from scratch.
+ *
+ * Transactions entering the mempool are appended as long as their in-mempool
+ * parents are already in the template, they fit, and their feerate doesn't
+ * exceed that of the last package, which keeps the ancestor feerate order of
+ * BlockAssembler; transactions leaving it are removed together with their
+ * in-template descendants. The coinbase of a template changed this way is
+ * only updated, and the template checked with TestBlockValidity, when it is
+ * handed out.
+ *
+ * The template is assembled anew with BlockAssembler when the tip changes.
+ * Transactions that were left out are only picked up by such a rebuild, which
+ * is done while templates are being asked for: right away for one that
+ * outranks the end of the template, otherwise at most every
+ * BLOCK_TEMPLATE_REBUILD_INTERVAL seconds.
+ *
+ * Once no template was asked for in BLOCK_TEMPLATE_IDLE_TIMEOUT seconds, the
+ * mempool and the tip are no longer followed; the next caller gets nullptr
+ * and the template is assembled again for the ones after it.
+ */
+class BlockTemplateUpdater final : public CValidationInterface
+{
+public:
+    explicit BlockTemplateUpdater(const CChainParams& params);
+    ~BlockTemplateUpdater();
+
+    /** Return the current template if it builds on pindexPrev, the tip, or nullptr.
+      * nTransactionsUpdated is set to the mempool's counter it reflects. */
+    std::shared_ptr<const CBlockTemplate> GetBlockTemplate(const CBlockIndex* pindexPrev, unsigned int& nTransactionsUpdated);
+
+    /** Wait until the changes notified so far are reflected in the template */
+    void SyncWithUpdates();
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+
+private:
+    void ThreadUpdate();
+    /** Assemble the template from scratch */
+    void Rebuild();
+    /** Append a mempool transaction, if its parents are in the template and it fits */
+    bool AddTransaction(CTxMemPool::txiter it);
+    /** Drop the given transactions and everything spending them from the template */
+    bool RemoveTransactions(const std::set<uint256>& hashes);
+    /** Recompute the coinbase value and witness commitment after the transactions changed */
+    void UpdateCoinbase(CBlockTemplate& blocktemplate, const CBlockIndex* pindex) const;
+    /** Whether the template is still asked for, stop updating it if not; cs must be held */
+    bool KeepUpdating();
+
+    const CChainParams& chainparams;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    std::condition_variable condIdle;
+    bool fQuit;
+    bool fRebuild;
+    /** Whether the template is kept up to date, as templates were asked for recently */
+    bool fActive;
+    int64_t nLastPoll;
+    /** Whether a template was asked for since the last rebuild */
+    bool fPolled;
+    /** Whether the update thread has to look at fPolled again */
+    bool fWake;
+    /** Whether the update thread is applying changes */
+    bool fBusy;
+    /** Mempool changes not yet applied, as (transaction, added) in the order they happened */
+    std::vector<std::pair<CTransactionRef, bool>> vQueued;
+    std::shared_ptr<const CBlockTemplate> published;
+    const CBlockIndex* pindexPublished;
+    unsigned int nTransactionsUpdatedPublished;
+    /** Whether the published template has its coinbase updated and was validated */
+    bool fPublishedFinal;
+
+    // Only used by the update thread
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    const CBlockIndex* pindexPrev;
+    std::set<uint256> setInBlock;
+    uint64_t nBlockWeight;
+    uint64_t nBlockSigOpsCost;
+    CAmount nFees;
+    int nHeight;
+    int64_t nLockTimeCutoff;
+    bool fIncludeWitness;
+    unsigned int nBlockMaxWeight;
+    CFeeRate blockMinFeeRate;
+    /** Lowest ancestor feerate in the template; anything above it goes in with a rebuild */
+    CFeeRate tailFeeRate;
+    /** Whether a mempool transaction was left out for lack of space or of its parents */
+    bool fMissingTxs;
+    /** Whether a transaction was left out because it would have come before the end of the template */
+    bool fOutranked;
+    int64_t nLastRebuild;
+
+    std::thread thread;
+};
+
+extern std::unique_ptr<BlockTemplateUpdater> g_blocktemplateupdater;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -26,6 +26,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -42,6 +46,21 @@
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for sockets at most, to check for things to send
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+
+#ifdef HAVE_EPOLL
+// Maximum number of events taken from epoll at once (the rest are taken the next time)
+static const int MAX_EPOLL_EVENTS = 1024;
+#endif
+
+// Maximum number of buffers handed to the kernel in one send. Windows sends one buffer at a time.
+#ifdef WIN32
+static const int MAX_SEND_BUFFERS = 1;
+#else
+static const int MAX_SEND_BUFFERS = 64;
+#endif
+
 #if !defined(HAVE_MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
 #endif
@@ -448,6 +467,11 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
         CloseSocket(hSocket);
         return nullptr;
     }
+    if (m_epoll_fd == -1 && !IsSelectableSocket(hSocket)) {
+        LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
+        CloseSocket(hSocket);
+        return nullptr;
+    }
 
     // Add node
     NodeId id = GetNewNodeId();
@@ -880,31 +904,71 @@ const uint256& CNetMessage::GetMessageHash() const
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (!pnode->vSendMsg.empty()) {
+        // Gather the headers and payloads of as many queued messages as
+        // possible, so that they go out in one system call.
+        const unsigned char* bufs[MAX_SEND_BUFFERS];
+        size_t lens[MAX_SEND_BUFFERS];
+        int nBufs = 0;
+        size_t nGathered = 0;
+        size_t nSkip = pnode->nSendOffset;
+        for (auto it = pnode->vSendMsg.cbegin(); it != pnode->vSendMsg.cend() && nBufs < MAX_SEND_BUFFERS; ++it) {
+            for (const std::vector<unsigned char>* buf : {&it->header, &it->payload->data}) {
+                if (nSkip >= buf->size()) {
+                    nSkip -= buf->size();
+                    continue;
+                }
+                if (nBufs == MAX_SEND_BUFFERS) break;
+                bufs[nBufs] = buf->data() + nSkip;
+                lens[nBufs] = buf->size() - nSkip;
+                nGathered += lens[nBufs];
+                nBufs++;
+                nSkip = 0;
+            }
+        }
+        assert(nBufs > 0);
+
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(bufs[0]), lens[0], MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            struct iovec iov[MAX_SEND_BUFFERS];
+            for (int i = 0; i < nBufs; i++) {
+                iov[i].iov_base = const_cast<unsigned char*>(bufs[i]);
+                iov[i].iov_len = lens[i];
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nBufs;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the messages that went out entirely.
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nMessageSize = pnode->vSendMsg.front().size();
+                if (pnode->nSendOffset + nLeft < nMessageSize) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nMessageSize - pnode->nSendOffset;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
+                pnode->nSendSize -= nMessageSize;
                 pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+                pnode->vSendMsg.pop_front();
+            }
+            if ((size_t)nBytes < nGathered) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -922,11 +986,11 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+    UpdateSendEvents(pnode);
     return nSentSize;
 }
 
@@ -1103,7 +1167,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket))
+    if (m_epoll_fd == -1 && !IsSelectableSocket(hSocket))
     {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
@@ -1138,6 +1202,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addr, CalculateKeyedNetGroup(addr), nonce, addr_bind, "", true);
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
+    AddSocketEvents(pnode);
     m_msgproc->InitializeNode(pnode);
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
@@ -1148,24 +1213,227 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 }
 
+bool CConnman::SocketEventsSelect()
+{
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000; // frequency to poll pnode->vSend
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        FD_SET(hListenSocket.socket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
+        have_fds = true;
+    }
+
+    m_select_sockets.clear();
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes)
+        {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this only
+            //   happens when optimistic write failed, we choose to first drain the
+            //   write buffer in this case before receiving more. This avoids
+            //   needlessly queueing received data, if the remote peer is not themselves
+            //   receiving data. This means properly utilizing TCP flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer, select() for
+            //   receiving data.
+            // * Hand off all complete messages to the processor, to be handled without
+            //   blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            have_fds = true;
+            m_select_sockets.emplace_back(pnode, pnode->hSocket);
+
+            if (select_send) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (select_recv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                         &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet)
+        return false;
+
+    if (nSelect == SOCKET_ERROR)
+    {
+        if (have_fds)
+        {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (unsigned int i = 0; i <= hSocketMax; i++)
+                FD_SET(i, &fdsetRecv);
+        }
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+            return false;
+    }
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        if (FD_ISSET(hListenSocket.socket, &fdsetRecv))
+            m_listen_ready.push_back(&hListenSocket);
+    }
+    // select() asks about every peer, so all of them are serviced, with the
+    // readiness of this round only.
+    for (const auto& node_socket : m_select_sockets) {
+        CNode* pnode = node_socket.first;
+        SOCKET hSocket = node_socket.second;
+        pnode->fRecvReady = FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError);
+        pnode->fSendReady = FD_ISSET(hSocket, &fdsetSend);
+        m_nodes_ready.push_back(pnode);
+    }
+    return true;
+}
+
+#ifdef HAVE_EPOLL
+bool CConnman::SocketEventsEpoll(bool fOnlyPoll)
+{
+    epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, fOnlyPoll ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet)
+        return false;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("epoll_wait error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+                return false;
+        }
+        return true;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        const void* ptr = events[i].data.ptr;
+        auto listen_it = std::find_if(vhListenSocket.begin(), vhListenSocket.end(), [ptr](const ListenSocket& hListenSocket) { return &hListenSocket == ptr; });
+        if (listen_it != vhListenSocket.end()) {
+            m_listen_ready.push_back(&*listen_it);
+            continue;
+        }
+        // Peers stay allocated until this thread deletes them, which it only
+        // does after their socket, and with it the registration, is closed.
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        // Edge-triggered events come once, so remember that the socket is
+        // readable or writable until it has been read from or written to.
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            pnode->fRecvReady = true;
+        if (events[i].events & EPOLLOUT)
+            pnode->fSendReady = true;
+        m_nodes_ready.push_back(pnode);
+    }
+    return true;
+}
+#endif
+
+bool CConnman::SocketEvents(bool fOnlyPoll)
+{
+    m_listen_ready.clear();
+    m_nodes_ready.clear();
+#ifdef HAVE_EPOLL
+    if (m_epoll_fd != -1)
+        return SocketEventsEpoll(fOnlyPoll);
+#endif
+    return SocketEventsSelect();
+}
+
+void CConnman::AddSocketEvents(CNode* pnode)
+{
+#ifdef HAVE_EPOLL
+    if (m_epoll_fd == -1)
+        return;
+    LOCK(pnode->cs_hSocket);
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed to add socket of peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+    // Data may arrive before the socket handler knows about the peer, and
+    // that event would be lost, so try reading once to start with.
+    pnode->fRecvReady = true;
+#endif
+}
+
+// requires LOCK(cs_vSend)
+void CConnman::UpdateSendEvents(CNode* pnode) const
+{
+#ifdef HAVE_EPOLL
+    // Only ask to hear about the socket becoming writable while there is something to write.
+    const bool fWantSend = !pnode->vSendMsg.empty();
+    if (m_epoll_fd == -1 || pnode->fSendEventsArmed == fWantSend)
+        return;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET | (fWantSend ? uint32_t(EPOLLOUT) : 0);
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, pnode->hSocket, &event) == 0) {
+        pnode->fSendEventsArmed = fWantSend;
+    } else {
+        LogPrintf("epoll_ctl failed to update socket of peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+    }
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    // Peers whose socket epoll reported readable, and that may have more data
+    // waiting to be read. They hold a reference until serviced again.
+    std::vector<CNode*> vNodesMoreRecv;
+    int64_t nNextFullPass = 0;
     while (!interruptNet)
     {
+        // With epoll, only every so often go through all peers, rather than
+        // only those with socket events: this disconnects peers, picks up those
+        // that had to wait to be read from, and checks all of them for inactivity.
+        const bool fFullPass = m_epoll_fd == -1 || GetTimeMillis() >= nNextFullPass;
+        if (fFullPass)
+            nNextFullPass = GetTimeMillis() + SELECT_TIMEOUT_MILLISECONDS;
+
         //
         // Disconnect nodes
         //
+        if (fFullPass)
         {
             LOCK(cs_vNodes);
             // Disconnect unused nodes
-            std::vector<CNode*> vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
+            for (std::vector<CNode*>::iterator it = vNodes.begin(); it != vNodes.end();)
             {
+                CNode* pnode = *it;
                 if (pnode->fDisconnect)
                 {
                     // remove from vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+                    it = vNodes.erase(it);
 
                     // release outbound grant (if any)
                     pnode->grantOutbound.Release();
@@ -1176,30 +1444,32 @@ void CConnman::ThreadSocketHandler()
                     // hold in disconnected pool until all refs are released
                     pnode->Release();
                     vNodesDisconnected.push_back(pnode);
+                } else {
+                    ++it;
                 }
             }
         }
         {
             // Delete disconnected nodes
-            std::list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            for (CNode* pnode : vNodesDisconnectedCopy)
+            for (std::list<CNode*>::iterator it = vNodesDisconnected.begin(); it != vNodesDisconnected.end();)
             {
+                CNode* pnode = *it;
                 // wait until threads are done using it
+                bool fDelete = false;
                 if (pnode->GetRefCount() <= 0) {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_inventory, lockInv);
-                        if (lockInv) {
-                            TRY_LOCK(pnode->cs_vSend, lockSend);
-                            if (lockSend) {
-                                fDelete = true;
-                            }
+                    TRY_LOCK(pnode->cs_inventory, lockInv);
+                    if (lockInv) {
+                        TRY_LOCK(pnode->cs_vSend, lockSend);
+                        if (lockSend) {
+                            fDelete = true;
                         }
                     }
-                    if (fDelete) {
-                        vNodesDisconnected.remove(pnode);
-                        DeleteNode(pnode);
-                    }
+                }
+                if (fDelete) {
+                    it = vNodesDisconnected.erase(it);
+                    DeleteNode(pnode);
+                } else {
+                    ++it;
                 }
             }
         }
@@ -1217,107 +1487,32 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec  = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode* pnode : vNodes)
-            {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
-                //   happens when optimistic write failed, we choose to first drain the
-                //   write buffer in this case before receiving more. This avoids
-                //   needlessly queueing received data, if the remote peer is not themselves
-                //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
-                //   receiving data.
-                // * Hand off all complete messages to the processor, to be handled without
-                //   blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (!SocketEvents(!vNodesMoreRecv.empty()))
+            return;
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR)
-        {
-            if (have_fds)
-            {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
-                return;
-        }
-
         //
         // Accept new connections
         //
-        for (const ListenSocket& hListenSocket : vhListenSocket)
+        for (const ListenSocket* hListenSocket : m_listen_ready)
         {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv))
-            {
-                AcceptConnection(hListenSocket);
-            }
+            AcceptConnection(*hListenSocket);
         }
 
         //
         // Service each socket
         //
-        std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy)
+            if (m_epoll_fd != -1 && fFullPass)
+                m_nodes_ready = vNodes;
+            for (CNode* pnode : m_nodes_ready)
                 pnode->AddRef();
         }
-        for (CNode* pnode : vNodesCopy)
+        m_nodes_ready.insert(m_nodes_ready.end(), vNodesMoreRecv.begin(), vNodesMoreRecv.end());
+        vNodesMoreRecv.clear();
+        for (CNode* pnode : m_nodes_ready)
         {
             if (interruptNet)
                 return;
@@ -1325,18 +1520,25 @@ void CConnman::ThreadSocketHandler()
             //
             // Receive
             //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
+            bool recvSet = pnode->fRecvReady;
+            bool sendSet = pnode->fSendReady;
+            pnode->fSendReady = false;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
             }
-            if (recvSet || errorSet)
+            if (m_epoll_fd != -1) {
+                // Read from a readable socket when select() would have been
+                // asked to: after draining the send buffer, and while not paused.
+                bool fSendQueued;
+                {
+                    LOCK(pnode->cs_vSend);
+                    fSendQueued = !pnode->vSendMsg.empty();
+                }
+                recvSet = recvSet && !pnode->fPauseRecv && !fSendQueued;
+            }
+            if (recvSet)
             {
                 // typical socket buffer is 8K-64K
                 char pchBuf[0x10000];
@@ -1349,6 +1551,12 @@ void CConnman::ThreadSocketHandler()
                 }
                 if (nBytes > 0)
                 {
+                    if (nBytes < (int)sizeof(pchBuf)) {
+                        pnode->fRecvReady = false;
+                    } else if (m_epoll_fd != -1 && !pnode->fPauseRecv) {
+                        pnode->AddRef();
+                        vNodesMoreRecv.push_back(pnode);
+                    }
                     bool notify = false;
                     if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
                         pnode->CloseSocketDisconnect();
@@ -1373,6 +1581,7 @@ void CConnman::ThreadSocketHandler()
                 else if (nBytes == 0)
                 {
                     // socket closed gracefully
+                    pnode->fRecvReady = false;
                     if (!pnode->fDisconnect) {
                         LogPrint(BCLog::NET, "socket closed\n");
                     }
@@ -1382,6 +1591,8 @@ void CConnman::ThreadSocketHandler()
                 {
                     // error
                     int nErr = WSAGetLastError();
+                    if (nErr != WSAEINTR)
+                        pnode->fRecvReady = false;
                     if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
                     {
                         if (!pnode->fDisconnect)
@@ -1438,7 +1649,7 @@ void CConnman::ThreadSocketHandler()
         }
         {
             LOCK(cs_vNodes);
-            for (CNode* pnode : vNodesCopy)
+            for (CNode* pnode : m_nodes_ready)
                 pnode->Release();
         }
     }
@@ -1448,9 +1659,9 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        nMsgProcWake++;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1994,6 +2205,7 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     if (manual_connection)
         pnode->m_manual_connection = true;
 
+    AddSocketEvents(pnode);
     m_msgproc->InitializeNode(pnode);
     {
         LOCK(cs_vNodes);
@@ -2003,16 +2215,24 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
     while (!flagInterruptMsgProc)
     {
+        uint64_t nWakeSeen;
+        {
+            std::lock_guard<std::mutex> lock(mutexMsgProc);
+            nWakeSeen = nMsgProcWake;
+        }
+
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
-                pnode->AddRef();
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % nMessageHandlerThreads == nThread) {
+                    vNodesCopy.push_back(pnode);
+                    pnode->AddRef();
+                }
             }
         }
 
@@ -2046,9 +2266,8 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWakeSeen] { return nMsgProcWake != nWakeSeen || flagInterruptMsgProc; });
         }
-        fMsgProcWake = false;
     }
 }
 
@@ -2214,6 +2433,8 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
     flagInterruptMsgProc = false;
+    nMsgProcWake = 0;
+    m_epoll_fd = -1;
     SetTryNewOutboundPeer(false);
 
     Options connOptions;
@@ -2280,6 +2501,25 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         return false;
     }
 
+#ifdef HAVE_EPOLL
+    if (connOptions.m_use_epoll) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            LogPrintf("Failed to create epoll instance, using select() instead: %s\n", NetworkErrorString(WSAGetLastError()));
+        } else {
+            for (ListenSocket& hListenSocket : vhListenSocket) {
+                epoll_event event;
+                event.events = EPOLLIN;
+                event.data.ptr = &hListenSocket;
+                if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+                    LogPrintf("epoll_ctl failed to add listening socket: %s\n", NetworkErrorString(WSAGetLastError()));
+                }
+            }
+        }
+    }
+#endif
+    LogPrintf("Using %s to wait for sockets\n", m_epoll_fd != -1 ? "epoll" : "select");
+
     for (const auto& strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2341,7 +2581,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        nMsgProcWake = 0;
     }
 
     // Send and receive from sockets, accept connections
@@ -2367,7 +2607,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        threadMessageHandlers.emplace_back(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2416,8 +2658,10 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2451,6 +2695,12 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef HAVE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2728,6 +2978,9 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nRefCount = 0;
     nSendSize = 0;
     nSendOffset = 0;
+    fSendEventsArmed = false;
+    fRecvReady = false;
+    fSendReady = false;
     hashContinue = uint256();
     nStartingHeight = -1;
     filterInventoryKnown.reset();
@@ -2804,6 +3057,24 @@ void CNode::AskFor(const CInv& inv)
     mapAskFor.insert(std::make_pair(nRequestTime, inv));
 }
 
+CNetMsgPayload::CNetMsgPayload(std::vector<unsigned char>&& dataIn) : data(std::move(dataIn))
+{
+    uint256 hash = Hash(data.data(), data.data() + data.size());
+    memcpy(checksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+}
+
+CSerializedNetMsg CSerializedNetMsg::Share()
+{
+    if (!payload) {
+        payload = std::make_shared<const CNetMsgPayload>(std::move(data));
+        data.clear();
+    }
+    CSerializedNetMsg msg;
+    msg.command = command;
+    msg.payload = payload;
+    return msg;
+}
+
 bool CConnman::NodeFullyConnected(const CNode* pnode)
 {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
@@ -2811,17 +3082,17 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    CQueuedNetMsg queued;
+    queued.payload = msg.payload ? std::move(msg.payload) : std::make_shared<const CNetMsgPayload>(std::move(msg.data));
+    size_t nMessageSize = queued.payload->data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    queued.header.reserve(CMessageHeader::HEADER_SIZE);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    memcpy(hdr.pchChecksum, queued.payload->checksum, CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, queued.header, 0, hdr};
 
     size_t nBytesSent = 0;
     {
@@ -2834,9 +3105,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::move(queued));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -81,6 +81,16 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 static const bool DEFAULT_BLOCKSONLY = false;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
+/** Default for -socketevents, how the socket handler waits for sockets to become ready */
+#ifdef HAVE_EPOLL
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+/** Default for -msghandlerthreads, the number of threads processing messages from peers */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum value for -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
@@ -100,6 +110,20 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * A serialized message payload and its checksum. It is immutable once made,
+ * so the same payload can be queued for many peers, and is kept in memory
+ * once, until the last of them has sent it.
+ */
+struct CNetMsgPayload
+{
+    explicit CNetMsgPayload(std::vector<unsigned char>&& dataIn);
+
+    const std::vector<unsigned char> data;
+    unsigned char checksum[CMessageHeader::CHECKSUM_SIZE];
+};
+typedef std::shared_ptr<const CNetMsgPayload> CNetMsgPayloadRef;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -111,6 +135,24 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+    //! If set, the payload to send instead of data.
+    CNetMsgPayloadRef payload;
+
+    /**
+     * Return a message with the same command that refers to the same payload,
+     * moving data into a shared payload first if needed. Use it to send one
+     * message to many peers without serializing or copying it for each.
+     */
+    CSerializedNetMsg Share();
+};
+
+/** A message in a peer's send queue: its header, and a payload that may be queued for other peers too. */
+struct CQueuedNetMsg
+{
+    std::vector<unsigned char> header;
+    CNetMsgPayloadRef payload;
+
+    size_t size() const { return header.size() + payload->data.size(); }
 };
 
 class NetEventsInterface;
@@ -139,6 +181,8 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        int nMessageHandlerThreads = 1;
+        bool m_use_epoll = false;
         std::vector<std::string> vSeedNodes;
         std::vector<CSubNet> vWhitelistedRange;
         std::vector<CService> vBinds, vWhiteBinds;
@@ -158,6 +202,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nMessageHandlerThreads = std::max(1, std::min(MAX_MSGHANDLER_THREADS, connOptions.nMessageHandlerThreads));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -281,6 +326,9 @@ public:
 
     ServiceFlags GetLocalServices() const;
 
+    //! Number of threads processing messages from peers
+    int GetMessageHandlerThreads() const { return nMessageHandlerThreads; }
+
     //!set the max outbound target in bytes
     void SetMaxOutboundTarget(uint64_t limit);
     uint64_t GetMaxOutboundTarget();
@@ -329,9 +377,21 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
+    /**
+     * Wait for sockets to become ready, or for up to SELECT_TIMEOUT_MILLISECONDS, or not at all if fOnlyPoll.
+     * Listening sockets with connections to accept go to m_listen_ready, peers with socket events to
+     * m_nodes_ready, with their fRecvReady and fSendReady set. Returns false if interrupted.
+     */
+    bool SocketEvents(bool fOnlyPoll);
+    bool SocketEventsSelect();
+#ifdef HAVE_EPOLL
+    bool SocketEventsEpoll(bool fOnlyPoll);
+#endif
+    void AddSocketEvents(CNode* pnode);
+    void UpdateSendEvents(CNode* pnode) const;
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -387,6 +447,17 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    /**
+     * epoll instance the sockets are registered with, or -1 if the socket
+     * handler uses select(). Listening sockets are level-triggered, peers'
+     * sockets edge-triggered, and only report being writable while there is
+     * something in their vSendMsg.
+     */
+    int m_epoll_fd;
+    //! Results of SocketEvents, and select()'s list of sockets, kept to not allocate them on every wakeup (socket handler only).
+    std::vector<const ListenSocket*> m_listen_ready;
+    std::vector<CNode*> m_nodes_ready;
+    std::vector<std::pair<CNode*, SOCKET>> m_select_sockets;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -418,8 +489,14 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /**
+     * Peers are shared out between the message processing threads by id, so
+     * that all messages of a peer are processed by the same thread, in order.
+     */
+    int nMessageHandlerThreads;
+
+    /** Counter for waking the message processors: each waits for it to change after going over its peers. */
+    uint64_t nMsgProcWake;
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -431,7 +508,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -608,9 +685,15 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CQueuedNetMsg> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
+    //! Whether epoll was asked to report the socket writable, protected by cs_vSend.
+    bool fSendEventsArmed;
+    //! Whether the socket was reported readable, and it may not have been read to the end yet (socket handler only).
+    bool fRecvReady;
+    //! Whether the socket was reported writable since it was last serviced (socket handler only).
+    bool fSendReady;
     CCriticalSection cs_vRecv;
 
     CCriticalSection cs_vProcessMsg;
@@ -672,6 +755,8 @@ public:
     // flood relay
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
+    //! Guards vAddrToSend and addrKnown, which other peers' message handler threads push addresses to.
+    CCriticalSection cs_vAddrToSend;
     bool fGetAddr;
     std::set<uint256> setKnown;
     int64_t nNextAddrSend;
@@ -792,6 +877,7 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
@@ -800,6 +886,7 @@ public:
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
+        LOCK(cs_vAddrToSend);
         if (_addr.IsValid() && !addrKnown.contains(_addr.GetKey())) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
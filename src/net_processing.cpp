@@ -7,7 +7,9 @@
 
 #include <addrman.h>
 #include <arith_uint256.h>
+#include <blockcache.h>
 #include <blockencodings.h>
+#include <blockreadpool.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
@@ -130,8 +132,21 @@ namespace {
     /** When our tip was last updated. */
     std::atomic<int64_t> g_last_tip_update(0);
 
+    /**
+     * A transaction in the relay map, and its tx messages with and without
+     * witness, each serialized the first time a peer asks for it and then
+     * shared by all the peers that ask.
+     */
+    struct RelayTx {
+        CTransactionRef tx;
+        CSerializedNetMsg msg;
+        CSerializedNetMsg msgNoWitness;
+
+        explicit RelayTx(CTransactionRef txIn) : tx(std::move(txIn)) {}
+    };
+
     /** Relay map, protected by cs_main. */
-    typedef std::map<uint256, CTransactionRef> MapRelay;
+    typedef std::map<uint256, RelayTx> MapRelay;
     MapRelay mapRelay;
     /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
@@ -845,6 +860,10 @@ static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
+// Serialized with witnesses, once for all the peers they are sent to. The block
+// message is only made when a peer asks for it.
+static CSerializedNetMsg most_recent_compact_block_msg;
+static CSerializedNetMsg most_recent_block_msg;
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
@@ -859,6 +878,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
     bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
     uint256 hashBlock(pblock->GetHash());
+    CSerializedNetMsg cmpctblock_msg = msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock);
 
     {
         LOCK(cs_most_recent_block);
@@ -866,10 +886,11 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        most_recent_compact_block_msg = cmpctblock_msg.Share();
+        most_recent_block_msg = CSerializedNetMsg();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
+    connman->ForEachNode([this, &cmpctblock_msg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) {
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -881,7 +902,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, cmpctblock_msg.Share());
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1038,6 +1059,137 @@ static void RelayAddress(const CAddress& addr, bool fReachable, CConnman* connma
     connman->ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
+/** A block to send in response to a getdata, once it is loaded. */
+struct BlockDataResponse
+{
+    CInv inv;
+    CDiskBlockPos pos;
+    //! The block, or for fRaw its serialization with witnesses, once loaded.
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<unsigned char> raw;
+    //! Whether the block can be sent as it is stored on disk.
+    bool fRaw = false;
+    //! For MSG_CMPCT_BLOCK: whether to send a compact block, with witnesses, and the one to send if it's ready.
+    bool fCompact = false;
+    bool fPeerWantsWitness = false;
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcompactblock;
+    //! If not null, the tip to announce after the block, for the peer's next getblocks.
+    uint256 hashContinueTip;
+};
+
+/** Read the block of a getdata response from disk, if it's not there yet. */
+static bool LoadBlockData(BlockDataResponse& response, const Consensus::Params& consensusParams)
+{
+    if (response.pblock || response.pcompactblock) {
+        return true;
+    }
+    if (response.fRaw) {
+        return ReadRawBlockFromDisk(response.raw, response.pos, Params().MessageStart());
+    }
+    std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblockRead, response.pos, consensusParams) || pblockRead->GetHash() != response.inv.hash)
+        return false;
+    if (g_blockcache) {
+        g_blockcache->Add(response.inv.hash, pblockRead);
+    }
+    response.pblock = pblockRead;
+    return true;
+}
+
+/**
+ * If pblock is the most recent block, get the block message with witnesses
+ * for it, serialized by the first peer that asks for it.
+ */
+static bool ShareMostRecentBlockMsg(const std::shared_ptr<const CBlock>& pblock, CSerializedNetMsg& msg)
+{
+    LOCK(cs_most_recent_block);
+    if (!pblock || pblock != most_recent_block) return false;
+    if (!most_recent_block_msg.payload) {
+        most_recent_block_msg = CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, *most_recent_block);
+    }
+    msg = most_recent_block_msg.Share();
+    return true;
+}
+
+/** If pcompactblock is the most recent compact block, get its message with witnesses. */
+static bool ShareMostRecentCompactBlockMsg(const std::shared_ptr<const CBlockHeaderAndShortTxIDs>& pcompactblock, CSerializedNetMsg& msg)
+{
+    LOCK(cs_most_recent_block);
+    if (!pcompactblock || pcompactblock != most_recent_compact_block) return false;
+    msg = most_recent_compact_block_msg.Share();
+    return true;
+}
+
+/** Send a loaded getdata response. */
+static void SendBlockData(CNode* pfrom, CConnman* connman, BlockDataResponse& response)
+{
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const CInv& inv = response.inv;
+    CSerializedNetMsg msg;
+    if (!response.pblock && !response.raw.empty()) {
+        msg.command = NetMsgType::BLOCK;
+        msg.data = std::move(response.raw);
+        connman->PushMessage(pfrom, std::move(msg));
+    } else if (inv.type == MSG_WITNESS_BLOCK && ShareMostRecentBlockMsg(response.pblock, msg)) {
+        connman->PushMessage(pfrom, std::move(msg));
+    } else if (inv.type == MSG_BLOCK)
+        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *response.pblock));
+    else if (inv.type == MSG_WITNESS_BLOCK)
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *response.pblock));
+    else if (inv.type == MSG_FILTERED_BLOCK)
+    {
+        bool sendMerkleBlock = false;
+        CMerkleBlock merkleBlock;
+        {
+            LOCK(pfrom->cs_filter);
+            if (pfrom->pfilter) {
+                sendMerkleBlock = true;
+                merkleBlock = CMerkleBlock(*response.pblock, *pfrom->pfilter);
+            }
+        }
+        if (sendMerkleBlock) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+            // This avoids hurting performance by pointlessly requiring a round-trip
+            // Note that there is currently no way for a node to request any single transactions we didn't send here -
+            // they must either disconnect and retry or request the full block.
+            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+            // however we MUST always provide at least what the remote peer needs
+            typedef std::pair<unsigned int, uint256> PairType;
+            for (PairType& pair : merkleBlock.vMatchedTxn)
+                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *response.pblock->vtx[pair.first]));
+        }
+        // else
+            // no response
+    }
+    else if (inv.type == MSG_CMPCT_BLOCK)
+    {
+        int nSendFlags = response.fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+        if (response.fCompact) {
+            if (response.fPeerWantsWitness && ShareMostRecentCompactBlockMsg(response.pcompactblock, msg)) {
+                connman->PushMessage(pfrom, std::move(msg));
+            } else if (response.pcompactblock) {
+                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *response.pcompactblock));
+            } else {
+                CBlockHeaderAndShortTxIDs cmpctblock(*response.pblock, response.fPeerWantsWitness);
+                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
+            }
+        } else {
+            connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *response.pblock));
+        }
+    }
+
+    if (!response.hashContinueTip.IsNull())
+    {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, response.hashContinueTip));
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+    }
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensusParams, const CInv& inv, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     bool send = false;
@@ -1081,7 +1233,6 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
             LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
         }
     }
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     // disconnect node in case we have reached the outbound limit for serving historical blocks
     // never disconnect whitelisted nodes
     if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - mi->second->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
@@ -1106,84 +1257,95 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
     // it's available before trying to send.
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
     {
-        std::shared_ptr<const CBlock> pblock;
+        BlockDataResponse response;
+        response.inv = inv;
+        response.pos = mi->second->GetBlockPos();
         if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
-            pblock = a_recent_block;
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (inv.type == MSG_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-        else if (inv.type == MSG_WITNESS_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-        else if (inv.type == MSG_FILTERED_BLOCK)
-        {
-            bool sendMerkleBlock = false;
-            CMerkleBlock merkleBlock;
-            {
-                LOCK(pfrom->cs_filter);
-                if (pfrom->pfilter) {
-                    sendMerkleBlock = true;
-                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
-                }
-            }
-            if (sendMerkleBlock) {
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                // This avoids hurting performance by pointlessly requiring a round-trip
-                // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                // they must either disconnect and retry or request the full block.
-                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                // however we MUST always provide at least what the remote peer needs
-                typedef std::pair<unsigned int, uint256> PairType;
-                for (PairType& pair : merkleBlock.vMatchedTxn)
-                    connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
-            }
-            // else
-                // no response
-        }
-        else if (inv.type == MSG_CMPCT_BLOCK)
-        {
+            response.pblock = a_recent_block;
+        } else if (g_blockcache) {
+            response.pblock = g_blockcache->Get(inv.hash);
+        }
+        // Blocks are stored with their witnesses, so when that's what the peer asked for, or
+        // the block can't have any, the bytes on disk can be sent as they are.
+        response.fRaw = inv.type == MSG_WITNESS_BLOCK || (inv.type == MSG_BLOCK && !IsWitnessEnabled(mi->second->pprev, consensusParams));
+        if (inv.type == MSG_CMPCT_BLOCK) {
             // If a peer is asking for old blocks, we're almost guaranteed
             // they won't have a useful mempool to match against a compact block,
             // and we don't feel like constructing the object for them, so
             // instead we respond with the full, non-compact block.
-            bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            if (CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                } else {
-                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                }
-            } else {
-                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+            response.fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            response.fCompact = CanDirectFetch(consensusParams) && mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+            if (response.fCompact && (response.fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
+                response.pcompactblock = a_recent_compact_block;
             }
         }
-
         // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom->hashContinue)
-        {
-            // Bypass PushInventory, this must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        if (inv.hash == pfrom->hashContinue) {
+            response.hashContinueTip = chainActive.Tip()->GetBlockHash();
             pfrom->hashContinue.SetNull();
         }
+
+        // Read the block in the background, unless it's in memory. Even then, queue it
+        // behind earlier blocks that are still being read, to keep the responses in order.
+        if (g_blockreadpool && (!response.pblock || g_blockreadpool->Pending(pfrom->GetId()) > 0)) {
+            const NodeId nodeid = pfrom->GetId();
+            g_blockreadpool->Queue(nodeid, [nodeid, response, &consensusParams, connman]() mutable {
+                // The block may have been pruned since it was requested.
+                const bool fLoaded = LoadBlockData(response, consensusParams);
+                connman->ForNode(nodeid, [&](CNode* pnode) {
+                    if (fLoaded) {
+                        SendBlockData(pnode, connman, response);
+                    } else {
+                        LogPrint(BCLog::NET, "cannot load block %s from disk, disconnect peer=%d\n", response.inv.hash.ToString(), nodeid);
+                        pnode->fDisconnect = true;
+                    }
+                    return true;
+                });
+                connman->WakeMessageHandler();
+            });
+            return;
+        }
+
+        if (!LoadBlockData(response, consensusParams))
+            assert(!"cannot load block from disk");
+        SendBlockData(pfrom, connman, response);
+    }
+}
+
+/**
+ * Whether the next getdata request of pfrom has to wait for the blocks it
+ * requested before, which are being read in the background.
+ */
+static bool GetDataWaitingForReads(CNode* pfrom)
+{
+    if (!g_blockreadpool || pfrom->vRecvGetData.empty())
+        return false;
+    const size_t nPending = g_blockreadpool->Pending(pfrom->GetId());
+    const CInv& inv = pfrom->vRecvGetData.front();
+    if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK)
+        return nPending >= MAX_BLOCK_READS_PER_PEER;
+    // Anything else would be answered before those blocks.
+    return nPending > 0;
+}
+
+/** Get the tx message for a relay map entry, serializing it if no peer asked for it before. */
+static CSerializedNetMsg ShareRelayTxMsg(RelayTx& relay, bool fWitness) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // Without witnesses, both serializations are the same.
+    CSerializedNetMsg& msg = (fWitness || !relay.tx->HasWitness()) ? relay.msg : relay.msgNoWitness;
+    if (!msg.payload) {
+        msg = CNetMsgMaker(PROTOCOL_VERSION).Make(fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *relay.tx);
     }
+    return msg.Share();
 }
 
 void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     AssertLockNotHeld(cs_main);
 
+    if (GetDataWaitingForReads(pfrom))
+        return;
+
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
@@ -1205,7 +1367,7 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             auto mi = mapRelay.find(inv.hash);
             int nSendFlags = (inv.type == MSG_TX ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
             if (mi != mapRelay.end()) {
-                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                connman->PushMessage(pfrom, ShareRelayTxMsg(mi->second, inv.type == MSG_WITNESS_TX));
                 push = true;
             } else if (pfrom->timeLastMempoolReq) {
                 auto txinfo = mempool.info(inv.hash);
@@ -2127,6 +2289,20 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
 
+        // With several message handler threads, verify the scripts before
+        // taking cs_main to accept the transaction, so that they can check
+        // transactions from different peers at the same time.
+        if (connman->GetMessageHandlerThreads() > 1) {
+            bool fAlreadyHave;
+            {
+                LOCK(cs_main);
+                fAlreadyHave = AlreadyHave(inv);
+            }
+            if (!fAlreadyHave) {
+                PreVerifyTransactionScripts(mempool, tx, 0 /* nAbsurdFee */);
+            }
+        }
+
         LOCK2(cs_main, g_cs_orphans);
 
         bool fMissingInputs = false;
@@ -2668,7 +2844,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_vAddrToSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr)
@@ -2908,7 +3087,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     // this maintains the order of responses
-    if (!pfrom->vRecvGetData.empty()) return true;
+    if (!pfrom->vRecvGetData.empty()) return !GetDataWaitingForReads(pfrom);
 
     // Don't bother if send buffer is too full to respond anyway
     if (pfrom->fPauseSend)
@@ -2966,7 +3145,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
         if (interruptMsgProc)
             return false;
-        if (!pfrom->vRecvGetData.empty())
+        if (!pfrom->vRecvGetData.empty() && !GetDataWaitingForReads(pfrom))
             fMoreWork = true;
     }
     catch (const std::ios_base::failure& e)
@@ -3215,6 +3394,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_vAddrToSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3352,7 +3532,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                            if (state.fWantsCmpctWitness)
+                                connman->PushMessage(pto, most_recent_compact_block_msg.Share());
+                            else if (!fWitnessesPresentInMostRecentCompactBlock)
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
@@ -3531,7 +3713,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                             vRelayExpiration.pop_front();
                         }
 
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
+                        auto ret = mapRelay.emplace(hash, std::move(txinfo.tx));
                         if (ret.second) {
                             vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
                         }
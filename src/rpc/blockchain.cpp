@@ -6,10 +6,12 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <blockreadpool.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinstats.h>
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
@@ -747,8 +749,6 @@ UniValue getblock(const JSONRPCRequest& request)
             + HelpExampleRpc("getblock", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -760,16 +760,25 @@ UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    std::shared_ptr<const CBlock> pblock;
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        if (mapBlockIndex.count(hash) == 0)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+        pblockindex = mapBlockIndex[hash];
+
+        if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+        pos = pblockindex->GetBlockPos();
+    }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    // Don't hold cs_main while waiting for the disk.
+    pblock = ReadBlockFromPool(pos, hash, Params().GetConsensus());
+    if (!pblock)
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -780,83 +789,13 @@ UniValue getblock(const JSONRPCRequest& request)
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
+        ssBlock << *pblock;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
-}
-
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase);
-    stats.nTransactions++;
-    for (const auto output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
+    LOCK(cs_main);
+    return blockToJSON(*pblock, pblockindex, verbosity >= 2);
 }
 
 UniValue pruneblockchain(const JSONRPCRequest& request)
@@ -910,29 +849,54 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
 
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless hash_type is \"muhash\".\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"        (string, optional, default=\"hash_serialized_2\") Which UTXO set hash to return:\n"
+            "                        \"hash_serialized_2\" scans the whole set and returns all statistics,\n"
+            "                        \"muhash\" returns the rolling hash that is kept up to date with the chain tip right away\n"
+            "                        (only with -muhash),\n"
+            "                        with only the fields marked below.\n"
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"height\":n,     (numeric) The current block height (index) (also with muhash)\n"
+            "  \"bestblock\": \"hex\",   (string) the best block hash hex (also with muhash)\n"
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
             "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"muhash\": \"hash\",      (string) The rolling multiset hash (only with muhash)\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (also with muhash)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\"")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
     UniValue ret(UniValue::VOBJ);
 
+    std::string hash_type = request.params[0].isNull() ? "hash_serialized_2" : request.params[0].get_str();
+    if (hash_type == "muhash") {
+        if (!fMuHash) {
+            throw JSONRPCError(RPC_MISC_ERROR, "The rolling UTXO set hash is not kept, restart with -muhash");
+        }
+        LOCK(cs_main);
+        uint256 muhash;
+        pcoinsTip->GetMuHash().Finalize(muhash.begin());
+        ret.push_back(Pair("height", (int64_t)chainActive.Height()));
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        ret.push_back(Pair("muhash", muhash.GetHex()));
+        ret.push_back(Pair("disk_size", (int64_t)pcoinsdbview->EstimateSize()));
+        return ret;
+    } else if (hash_type != "hash_serialized_2") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown hash_type " + hash_type);
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
     if (GetUTXOStats(pcoinsdbview.get(), stats)) {
@@ -950,6 +914,41 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getcoinscacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns statistics about the in-memory cache of the unspent transaction output set.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": n,        (numeric) The number of cached entries\n"
+            "  \"usage\": n,          (numeric) Memory usage of the cache in bytes\n"
+            "  \"maxusage\": n,       (numeric) Memory usage the cache is allowed to grow to in bytes, not counting unused mempool space\n"
+            "  \"hits\": n,           (numeric) Lookups answered from the cache since startup\n"
+            "  \"misses\": n,         (numeric) Lookups that went to the database since startup\n"
+            "  \"hitrate\": x.xxx,    (numeric) hits / (hits + misses)\n"
+            "  \"evicted\": n         (numeric) Entries evicted to keep the cache within its limit since startup\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VOBJ);
+    uint64_t nHits = pcoinsTip->GetHits();
+    uint64_t nMisses = pcoinsTip->GetMisses();
+    ret.push_back(Pair("entries", (int64_t)pcoinsTip->GetCacheSize()));
+    ret.push_back(Pair("usage", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    ret.push_back(Pair("maxusage", (int64_t)nCoinCacheUsage));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+    ret.push_back(Pair("hitrate", nHits + nMisses == 0 ? 0.0 : (double)nHits / (nHits + nMisses)));
+    ret.push_back(Pair("evicted", pcoinsTip->GetEvicted()));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1151,6 +1150,8 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"snapshotheight\": xxxxxx,     (numeric) height of the UTXO set snapshot the chain state was loaded from (only present if loaded with -loadtxoutset)\n"
+            "  \"snapshotvalidated\": xx,      (boolean) whether the blocks up to the snapshot are validated, which they are not: the chain state is only as good as the -assumeutxo hash (only present if loaded with -loadtxoutset)\n"
             "  \"softforks\": [                (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",           (string) name of softfork\n"
@@ -1214,6 +1215,12 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
+    const CBlockIndex* pindexSnapshotBase = GetSnapshotBase();
+    if (pindexSnapshotBase) {
+        obj.push_back(Pair("snapshotheight",     pindexSnapshotBase->nHeight));
+        obj.push_back(Pair("snapshotvalidated",  false));
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
     UniValue softforks(UniValue::VARR);
@@ -1597,9 +1604,130 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+/** Write the UTXO set at the tip to file, opened at temppath, and move it to path once complete. */
+static UniValue WriteTxOutSetSnapshot(CAutoFile& file, const fs::path& temppath, const fs::path& path)
+{
+    // Take the snapshot of a fully written database, and the headers leading
+    // to it, without letting the tip move in between.
+    std::unique_ptr<CDBSnapshot> snapshot;
+    std::vector<CBlockHeader> headers;
+    SnapshotMetadata metadata;
+    CBlockIndex* pindexBase;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        snapshot = pcoinsdbview->GetSnapshot();
+        pindexBase = mapBlockIndex.find(pcoinsdbview->GetBestBlock(*snapshot))->second;
+        headers.resize(pindexBase->nHeight);
+        for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+            headers[pindex->nHeight - 1] = pindex->GetBlockHeader();
+        }
+        metadata.hashBlock = pindexBase->GetBlockHash();
+        metadata.nChainTx = pindexBase->nChainTx;
+    }
+    if (headers.empty()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "No blocks to take a snapshot at");
+    }
+
+    // The number of coins and the hash are only known at the end, and are
+    // filled in then.
+    file << metadata << headers;
+    CCoinsStats stats;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata.hashBlock;
+    // Ranges are serialized in parallel, for the hash and for the file, and
+    // appended to both in order.
+    std::vector<CCoinsStats> vRangeStats(COIN_WALK_RANGES);
+    std::vector<std::vector<unsigned char>> vRangeHashData(COIN_WALK_RANGES);
+    std::vector<std::vector<unsigned char>> vRangeFileData(COIN_WALK_RANGES);
+    bool fWalked = pcoinsdbview->WalkCoins(*snapshot, [&](CCoinsViewCursor& cursor, size_t nRange) {
+        CVectorWriter hashWriter(SER_GETHASH, PROTOCOL_VERSION, vRangeHashData[nRange], 0);
+        CVectorWriter fileWriter(SER_DISK, CLIENT_VERSION, vRangeFileData[nRange], 0);
+        return ForEachTransaction(cursor, [&](const uint256& hash, const std::map<uint32_t, Coin>& outputs) {
+            ApplyStats(vRangeStats[nRange], hashWriter, hash, outputs);
+            fileWriter << hash << COMPACTSIZE(uint64_t(outputs.size()));
+            for (const auto& output : outputs) {
+                fileWriter << VARINT(output.first) << output.second;
+            }
+        });
+    }, [&](size_t nRange) {
+        boost::this_thread::interruption_point();
+        ss.write((const char*)vRangeHashData[nRange].data(), vRangeHashData[nRange].size());
+        file.write((const char*)vRangeFileData[nRange].data(), vRangeFileData[nRange].size());
+        std::vector<unsigned char>().swap(vRangeHashData[nRange]);
+        std::vector<unsigned char>().swap(vRangeFileData[nRange]);
+        AddStats(stats, vRangeStats[nRange]);
+    });
+    if (!fWalked) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+    }
+    metadata.nCoins = stats.nTransactionOutputs;
+    metadata.hashSerialized = ss.GetHash();
+    if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write " + temppath.string());
+    }
+    file << metadata;
+    file.fclose();
+    if (!RenameOver(temppath, path)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " + temppath.string() + " to " + path.string());
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("coins_written", metadata.nCoins));
+    ret.push_back(Pair("base_hash", metadata.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", pindexBase->nHeight));
+    ret.push_back(Pair("path", path.string()));
+    ret.push_back(Pair("hash_serialized_2", metadata.hashSerialized.GetHex()));
+    return ret;
+}
+
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the UTXO set at the current tip to a snapshot file, which can be loaded with -loadtxoutset.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) Path of the snapshot file. Relative paths are prefixed by the data directory.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,         (numeric) The number of coins written to the snapshot\n"
+            "  \"base_hash\": \"hash\",        (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,           (numeric) The height of that block\n"
+            "  \"path\": \"path\",             (string) The absolute path the snapshot was written to\n"
+            "  \"hash_serialized_2\": \"hash\" (string) The hash of the UTXO set, as in gettxoutsetinfo. Pass it to -assumeutxo to load the snapshot\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+    }
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+    CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unable to open " + temppath.string() + " for writing");
+    }
+    try {
+        return WriteTxOutSetSnapshot(file, temppath, path);
+    } catch (...) {
+        // Don't leave a partial snapshot behind, whatever went wrong.
+        file.fclose();
+        fs::remove(temppath);
+        throw;
+    }
+}
+
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
@@ -1608,6 +1736,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
@@ -1615,7 +1744,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
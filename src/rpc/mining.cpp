@@ -8,6 +8,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -291,12 +292,112 @@ std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+/** Transactions of a template handed out in stratum mode, kept to complete
+ *  blocks that are submitted as just a header and coinbase. */
+struct StratumWork
+{
+    uint256 hashPrevBlock;
+    std::vector<CTransactionRef> vtx;
+    std::vector<uint256> vMerkleBranch;
+    /** vtx serialized back to back, hex encoded */
+    std::string strTxData;
+};
+
+/** How many stratum templates on the current tip to keep for submitblock */
+static const size_t MAX_STRATUM_WORK = 32;
+/** Total size of the hex transaction data of the stratum templates kept, room for four full blocks */
+static const size_t MAX_STRATUM_WORK_SIZE = 8 * MAX_BLOCK_SERIALIZED_SIZE;
+
+static std::map<uint64_t, std::shared_ptr<const StratumWork>> mapStratumWork;
+static size_t nStratumWorkSize = 0;
+static uint64_t nLastStratumWorkId = 0;
+
+static std::map<uint64_t, std::shared_ptr<const StratumWork>>::iterator EraseStratumWork(std::map<uint64_t, std::shared_ptr<const StratumWork>>::iterator it)
+{
+    AssertLockHeld(cs_main);
+    nStratumWorkSize -= it->second->strTxData.size();
+    return mapStratumWork.erase(it);
+}
+
+/** Drop the stratum work that can't make a block on the tip */
+static void EraseStaleStratumWork(const uint256& hashTip)
+{
+    AssertLockHeld(cs_main);
+    for (auto it = mapStratumWork.begin(); it != mapStratumWork.end(); ) {
+        if (it->second->hashPrevBlock != hashTip) {
+            it = EraseStratumWork(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/** Forgets the stratum work of the old tip as soon as the tip changes */
+class StratumWorkTipListener final : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        LOCK(cs_main);
+        EraseStaleStratumWork(pindexNew->GetBlockHash());
+    }
+};
+
+static std::unique_ptr<StratumWorkTipListener> g_stratumworklistener;
+
+/** Return the work id and merkle branch and transaction data for the template's transactions */
+static std::pair<uint64_t, std::shared_ptr<const StratumWork>> GetStratumWork(const CBlock& block)
+{
+    AssertLockHeld(cs_main);
+
+    if (!g_stratumworklistener) {
+        g_stratumworklistener.reset(new StratumWorkTipListener());
+        RegisterValidationInterface(g_stratumworklistener.get());
+    }
+
+    // Hand out the same work for as long as the template doesn't change.
+    if (!mapStratumWork.empty()) {
+        auto last = mapStratumWork.rbegin();
+        const StratumWork& work = *last->second;
+        if (work.hashPrevBlock == block.hashPrevBlock && work.vtx.size() + 1 == block.vtx.size() &&
+            std::equal(work.vtx.begin(), work.vtx.end(), block.vtx.begin() + 1)) {
+            return *last;
+        }
+    }
+
+    // The listener may not have caught up with the tip yet.
+    EraseStaleStratumWork(block.hashPrevBlock);
+
+    std::shared_ptr<StratumWork> work = std::make_shared<StratumWork>();
+    work->hashPrevBlock = block.hashPrevBlock;
+    work->vtx.assign(block.vtx.begin() + 1, block.vtx.end());
+    // The coinbase's own hash isn't part of its branch.
+    std::vector<uint256> leaves(1);
+    leaves.reserve(block.vtx.size());
+    CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+    for (const CTransactionRef& tx : work->vtx) {
+        leaves.push_back(tx->GetHash());
+        ssTxs << *tx;
+    }
+    work->vMerkleBranch = ComputeMerkleBranch(leaves, 0);
+    work->strTxData = HexStr(ssTxs.begin(), ssTxs.end());
+
+    while (!mapStratumWork.empty() &&
+           (mapStratumWork.size() >= MAX_STRATUM_WORK || nStratumWorkSize + work->strTxData.size() > MAX_STRATUM_WORK_SIZE)) {
+        EraseStratumWork(mapStratumWork.begin());
+    }
+    nStratumWorkSize += work->strTxData.size();
+    return *mapStratumWork.emplace(++nLastStratumWorkId, std::move(work)).first;
+}
+
 UniValue getblocktemplate(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
             "getblocktemplate ( TemplateRequest )\n"
             "\nIf the request parameters include a 'mode' key, that is used to explicitly select between the default 'template' request or a 'proposal'.\n"
+            "A 'stratum' request returns a template with the transactions already serialized and the merkle branch of the coinbase,\n"
+            "identified by a workid with which submitblock accepts just the block header and coinbase.\n"
             "It returns data needed to construct a block to work on.\n"
             "For full specification, see BIPs 22, 23, 9, and 145:\n"
             "    https://github.com/bitcoin/bips/blob/master/bip-0022.mediawiki\n"
@@ -307,7 +408,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "\nArguments:\n"
             "1. template_request         (json object, optional) A json object in the following spec\n"
             "     {\n"
-            "       \"mode\":\"template\"    (string, optional) This must be set to \"template\", \"proposal\" (see BIP 23), or omitted\n"
+            "       \"mode\":\"template\"    (string, optional) This must be set to \"template\", \"proposal\" (see BIP 23), \"stratum\", or omitted\n"
             "       \"capabilities\":[     (array, optional) A list of strings\n"
             "           \"support\"          (string) client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'\n"
             "           ,...\n"
@@ -345,6 +446,13 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
             "      }\n"
             "      ,...\n"
             "  ],\n"
+            "  \"workid\" : \"xxxx\",                (string) stratum mode only: identifies the transactions for submitblock\n"
+            "  \"txcount\" : n,                    (numeric) stratum mode only: the number of non-coinbase transactions, in place of 'transactions'\n"
+            "  \"txdata\" : \"xxxx\",                (string) stratum mode only: the non-coinbase transactions serialized back to back, in hexadecimal\n"
+            "  \"merklebranch\" : [                (array of strings) stratum mode only: merkle branch of the coinbase, as hashes in hexadecimal byte order\n"
+            "      \"xxxx\"                          (string) hash to hash the coinbase's txid (or the result so far) with, on the right\n"
+            "      ,...\n"
+            "  ],\n"
             "  \"coinbaseaux\" : {                 (json object) data that should be included in the coinbase's scriptSig content\n"
             "      \"flags\" : \"xx\"                  (string) key name is to be ignored, and value included in scriptSig\n"
             "  },\n"
@@ -435,7 +543,7 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
         }
     }
 
-    if (strMode != "template")
+    if (strMode != "template" && strMode != "stratum")
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
 
     if(!g_connman)
@@ -508,7 +616,23 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     // Cache whether the last invocation was with segwit support, to avoid returning
     // a segwit-block to a non-segwit caller.
     static bool fLastTemplateSupportsSegwit = true;
-    if (pindexPrev != chainActive.Tip() ||
+    std::shared_ptr<const CBlockTemplate> pmaintained;
+    if (fSupportsSegwit) {
+        // Keep a template up to date in the background from now on, which
+        // spares assembling one for every call.
+        if (!g_blocktemplateupdater) {
+            g_blocktemplateupdater.reset(new BlockTemplateUpdater(Params()));
+            RegisterValidationInterface(g_blocktemplateupdater.get());
+        }
+        pmaintained = g_blocktemplateupdater->GetBlockTemplate(chainActive.Tip(), nTransactionsUpdatedLast);
+    }
+    if (pmaintained) {
+        pindexPrev = chainActive.Tip();
+        nStart = GetTime();
+        fLastTemplateSupportsSegwit = true;
+        // Copied, as the header fields are filled in below
+        pblocktemplate.reset(new CBlockTemplate(*pmaintained));
+    } else if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5) ||
         fLastTemplateSupportsSegwit != fSupportsSegwit)
     {
@@ -546,6 +670,10 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     std::map<uint256, int64_t> setTxIndex;
     int i = 0;
     for (const auto& it : pblock->vtx) {
+        // Stratum mode hands out the transactions serialized instead
+        if (strMode == "stratum")
+            break;
+
         const CTransaction& tx = *it;
         uint256 txHash = tx.GetHash();
         setTxIndex[txHash] = i++;
@@ -649,7 +777,19 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     result.push_back(Pair("previousblockhash", pblock->hashPrevBlock.GetHex()));
-    result.push_back(Pair("transactions", transactions));
+    if (strMode == "stratum") {
+        const std::pair<uint64_t, std::shared_ptr<const StratumWork>> work = GetStratumWork(*pblock);
+        UniValue branch(UniValue::VARR);
+        for (const uint256& hash : work.second->vMerkleBranch) {
+            branch.push_back(HexStr(hash.begin(), hash.end()));
+        }
+        result.push_back(Pair("workid", i64tostr(work.first)));
+        result.push_back(Pair("txcount", (int64_t)work.second->vtx.size()));
+        result.push_back(Pair("txdata", work.second->strTxData));
+        result.push_back(Pair("merklebranch", branch));
+    } else {
+        result.push_back(Pair("transactions", transactions));
+    }
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue));
     result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
@@ -681,6 +821,21 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
     return result;
 }
 
+static bool DecodeHexHeaderAndCoinbase(CBlockHeader& header, CMutableTransaction& coinbase, const std::string& strHex)
+{
+    if (!IsHex(strHex))
+        return false;
+
+    CDataStream ss(ParseHex(strHex), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ss >> header >> coinbase;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return ss.empty();
+}
+
 class submitblock_StateCatcher : public CValidationInterface
 {
 public:
@@ -701,16 +856,20 @@ protected:
 
 UniValue submitblock(const JSONRPCRequest& request)
 {
-    // We allow 2 arguments for compliance with BIP22. Argument 2 is ignored.
+    // We allow 2 arguments for compliance with BIP22. Only the workid of argument 2 is used.
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
         throw std::runtime_error(
-            "submitblock \"hexdata\"  ( \"dummy\" )\n"
+            "submitblock \"hexdata\"  ( parameters )\n"
             "\nAttempts to submit new block to network.\n"
             "See https://en.bitcoin.it/wiki/BIP_0022 for full specification.\n"
 
             "\nArguments\n"
-            "1. \"hexdata\"        (string, required) the hex-encoded block data to submit\n"
-            "2. \"dummy\"          (optional) dummy value, for compatibility with BIP22. This value is ignored.\n"
+            "1. \"hexdata\"        (string, required) the hex-encoded block data to submit, or for work from getblocktemplate\n"
+            "                     in stratum mode just the block header followed by the coinbase transaction\n"
+            "2. \"parameters\"     (json object, optional) for compatibility with BIP22; only the workid is used\n"
+            "     {\n"
+            "       \"workid\" : \"id\"  (string, optional) workid of the stratum template the block was built on\n"
+            "     }\n"
             "\nResult:\n"
             "\nExamples:\n"
             + HelpExampleCli("submitblock", "\"mydata\"")
@@ -720,7 +879,34 @@ UniValue submitblock(const JSONRPCRequest& request)
 
     std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
     CBlock& block = *blockptr;
-    if (!DecodeHexBlk(block, request.params[0].get_str())) {
+    bool fDecoded = false;
+    const UniValue& workid = request.params[1].isObject() ? find_value(request.params[1].get_obj(), "workid") : NullUniValue;
+    CBlockHeader header;
+    CMutableTransaction coinbase;
+    if (workid.isStr() && DecodeHexHeaderAndCoinbase(header, coinbase, request.params[0].get_str())) {
+        std::shared_ptr<const StratumWork> work;
+        {
+            LOCK(cs_main);
+            uint64_t id;
+            if (ParseUInt64(workid.get_str(), &id)) {
+                auto it = mapStratumWork.find(id);
+                // Work on a tip that was since replaced is as good as gone,
+                // even if the listener hasn't dropped it yet.
+                if (it != mapStratumWork.end() && it->second->hashPrevBlock == chainActive.Tip()->GetBlockHash()) {
+                    work = it->second;
+                }
+            }
+        }
+        if (!work) {
+            return "stale-work";
+        }
+        block = header;
+        block.vtx.reserve(work->vtx.size() + 1);
+        block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+        block.vtx.insert(block.vtx.end(), work->vtx.begin(), work->vtx.end());
+        fDecoded = true;
+    }
+    if (!fDecoded && !DecodeHexBlk(block, request.params[0].get_str())) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
     }
 
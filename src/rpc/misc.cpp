@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <base58.h>
+#include <blockcache.h>
 #include <chain.h>
 #include <clientversion.h>
 #include <core_io.h>
@@ -452,6 +453,19 @@ UniValue setmocktime(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue RPCBlockCacheInfo()
+{
+    CBlockCache::Stats stats = g_blockcache->GetStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks", (uint64_t)stats.nBlocks));
+    obj.push_back(Pair("usage", (uint64_t)stats.nUsage));
+    obj.push_back(Pair("maxusage", (uint64_t)stats.nMaxUsage));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+    obj.push_back(Pair("hitrate", stats.nHits + stats.nMisses > 0 ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    return obj;
+}
+
 static UniValue RPCLockedMemoryInfo()
 {
     LockedPool::Stats stats = LockedPoolManager::Instance().stats();
@@ -506,6 +520,14 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockcache\": {           (json object) Information about the cache of recently used blocks, if enabled (see -blockcache)\n"
+            "    \"blocks\": xxxxx,        (numeric) Number of blocks in the cache\n"
+            "    \"usage\": xxxxx,         (numeric) Number of bytes used by them\n"
+            "    \"maxusage\": xxxxx,      (numeric) Maximum number of bytes used\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups that found their block\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that didn't\n"
+            "    \"hitrate\": x.xxx,       (numeric) Fraction of lookups that found their block\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -519,6 +541,9 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        if (g_blockcache) {
+            obj.push_back(Pair("blockcache", RPCBlockCacheInfo()));
+        }
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
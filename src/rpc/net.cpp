@@ -429,6 +429,11 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  \"timeoffset\": xxxxx,                   (numeric) the time offset\n"
             "  \"connections\": xxxxx,                  (numeric) the number of connections\n"
             "  \"networkactive\": true|false,           (bool) whether p2p networking is enabled\n"
+            "  \"msghandlerthreads\": xxxxx,            (numeric) the number of threads processing messages from peers\n"
+            "  \"cs_main_contention\": {               (json object, only with DEBUG_LOCKCONTENTION builds) how often threads waited for the main lock, which serializes most message processing\n"
+            "    \"count\": xxxxx,                      (numeric) the number of times a thread had to wait for it\n"
+            "    \"waittime\": x.xxx                    (numeric) the total time waited, in seconds\n"
+            "  },\n"
             "  \"networks\": [                          (array) information per network\n"
             "  {\n"
             "    \"name\": \"xxx\",                     (string) network (ipv4, ipv6 or onion)\n"
@@ -468,7 +473,14 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
     if (g_connman) {
         obj.push_back(Pair("networkactive", g_connman->GetNetworkActive()));
         obj.push_back(Pair("connections",   (int)g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL)));
+        obj.push_back(Pair("msghandlerthreads", g_connman->GetMessageHandlerThreads()));
     }
+#ifdef DEBUG_LOCKCONTENTION
+    UniValue contention(UniValue::VOBJ);
+    contention.push_back(Pair("count", (uint64_t)cs_main.nContentions));
+    contention.push_back(Pair("waittime", cs_main.nContentionMicros * 0.000001));
+    obj.push_back(Pair("cs_main_contention", contention));
+#endif
     obj.push_back(Pair("networks",      GetNetworksInfo()));
     obj.push_back(Pair("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK())));
     obj.push_back(Pair("incrementalfee", ValueFromAmount(::incrementalRelayFee.GetFeePerK())));
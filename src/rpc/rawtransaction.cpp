@@ -960,6 +960,8 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     if (!request.params[1].isNull() && request.params[1].get_bool())
         nMaxRawTxFee = 0;
 
+    PreVerifyTransactionScripts(mempool, *tx, nMaxRawTxFee);
+
     { // cs_main scope
     LOCK(cs_main);
     CCoinsViewCache &view = *pcoinsTip;
@@ -1017,6 +1019,122 @@ UniValue sendrawtransaction(const JSONRPCRequest& request)
     return hashTx.GetHex();
 }
 
+UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "sendrawtransactions [\"hexstring\",...] ( allowhighfees )\n"
+            "\nSubmits several raw transactions (serialized, hex-encoded) to local node and network at once.\n"
+            "They are validated under one lock, each one after those it spends from, whatever their order,\n"
+            "so a chain of unconfirmed transactions can be sent in one call. Each transaction must meet the\n"
+            "fee requirements on its own. At most " + std::to_string(MAX_PACKAGE_COUNT) + " transactions, of at most\n"
+            + std::to_string(MAX_PACKAGE_SIZE) + " kilobytes in total, can be sent at once.\n"
+            "\nArguments:\n"
+            "1. \"hexstrings\"     (array, required) The hex strings of the raw transactions\n"
+            "2. allowhighfees    (boolean, optional, default=false) Allow high fees\n"
+            "\nResult:\n"
+            "[                   (array) One object per transaction, in the order given\n"
+            "  {\n"
+            "    \"txid\" : \"hash\",   (string) The transaction hash in hex\n"
+            "    \"error\" : \"msg\"    (string, optional) Why the transaction was not accepted, if it wasn't\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex1\\\",\\\"signedhex2\\\"]\"") +
+            "\nAs a json rpc call\n" +
+            HelpExampleRpc("sendrawtransactions", "[\"signedhex1\", \"signedhex2\"]")
+        );
+
+    ObserveSafeMode();
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    const UniValue& hexstrings = request.params[0].get_array();
+    if (hexstrings.size() > MAX_PACKAGE_COUNT)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("At most %u transactions can be sent at once", MAX_PACKAGE_COUNT));
+    std::vector<CTransactionRef> txs;
+    int64_t nPackageSize = 0;
+    for (unsigned int i = 0; i < hexstrings.size(); i++) {
+        CMutableTransaction mtx;
+        if (!hexstrings[i].isStr() || !DecodeHexTx(mtx, hexstrings[i].get_str()))
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+        nPackageSize += GetVirtualTransactionSize(*txs.back());
+    }
+    if (nPackageSize > MAX_PACKAGE_SIZE * 1000)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("The transactions can be at most %u kilobytes in total", MAX_PACKAGE_SIZE));
+
+    CAmount nMaxRawTxFee = maxTxFee;
+    if (!request.params[1].isNull() && request.params[1].get_bool())
+        nMaxRawTxFee = 0;
+
+    // Transactions that are confirmed already aren't submitted.
+    std::vector<bool> fHaveChain(txs.size(), false);
+    std::vector<CTransactionRef> package;
+    {
+        LOCK(cs_main);
+        CCoinsViewCache &view = *pcoinsTip;
+        for (size_t i = 0; i < txs.size(); i++) {
+            for (size_t o = 0; !fHaveChain[i] && o < txs[i]->vout.size(); o++) {
+                fHaveChain[i] = !view.AccessCoin(COutPoint(txs[i]->GetHash(), o)).IsSpent();
+            }
+            if (!fHaveChain[i]) package.push_back(txs[i]);
+        }
+    }
+
+    std::vector<MempoolAcceptResult> package_results = AcceptPackageToMemoryPool(mempool, package, nMaxRawTxFee);
+
+    UniValue result(UniValue::VARR);
+    std::vector<uint256> vRelay;
+    bool fAnyAccepted = false;
+    for (size_t i = 0, p = 0; i < txs.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("txid", txs[i]->GetHash().GetHex()));
+        if (fHaveChain[i]) {
+            entry.push_back(Pair("error", "transaction already in block chain"));
+        } else {
+            const MempoolAcceptResult& accept = package_results[p++];
+            if (accept.fAccepted) {
+                fAnyAccepted = true;
+                vRelay.push_back(txs[i]->GetHash());
+            } else if (accept.state.GetRejectCode() == REJECT_DUPLICATE && mempool.exists(txs[i]->GetHash())) {
+                // Re-sending a transaction already in the mempool relays it again.
+                vRelay.push_back(txs[i]->GetHash());
+            } else if (accept.state.IsInvalid()) {
+                entry.push_back(Pair("error", strprintf("%i: %s", accept.state.GetRejectCode(), accept.state.GetRejectReason())));
+            } else if (accept.fMissingInputs) {
+                entry.push_back(Pair("error", "Missing inputs"));
+            } else {
+                entry.push_back(Pair("error", accept.state.GetRejectReason()));
+            }
+        }
+        result.push_back(entry);
+    }
+
+    // As in sendrawtransaction, let the wallet see the new transactions before returning.
+    if (fAnyAccepted) {
+        std::promise<void> promise;
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+        promise.get_future().wait();
+    }
+
+    if (!vRelay.empty()) {
+        if (!g_connman)
+            throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+        g_connman->ForEachNode([&vRelay](CNode* pnode)
+        {
+            for (const uint256& hash : vRelay) {
+                pnode->PushInventory(CInv(MSG_TX, hash));
+            }
+        });
+    }
+
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1025,6 +1143,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",   &decoderawtransaction,   {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",           &decodescript,           {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",     &sendrawtransaction,     {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",    &sendrawtransactions,    {"hexstrings","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",  &combinerawtransaction,  {"txs"} },
     { "rawtransactions",    "signrawtransaction",     &signrawtransaction,     {"hexstring","prevtxs","privkeys","sighashtype"} }, /* uses wallet if enabled */
 
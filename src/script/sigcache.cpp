@@ -88,7 +88,17 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         return true;
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
-    if (store)
+    if (pvEntries)
+        pvEntries->push_back(entry);
+    else if (store)
         signatureCache.Set(entry);
     return true;
 }
+
+void AddSignatureCacheEntries(const std::vector<uint256>& entries)
+{
+    for (const uint256& entry : entries) {
+        uint256 copy = entry;
+        signatureCache.Set(copy);
+    }
+}
@@ -44,13 +44,18 @@ class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    /** If set, entries for valid signatures not in the cache are appended here rather than stored */
+    std::vector<uint256>* pvEntries;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, std::vector<uint256>* pvEntriesIn = nullptr) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), pvEntries(pvEntriesIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
 void InitSignatureCache();
 
+/** Store entries collected by a CachingTransactionSignatureChecker in the signature cache */
+void AddSignatureCacheEntries(const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,231 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <assert.h>
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Memory resource that carves small allocations out of large chunks.
+ *
+ * Node based containers such as std::unordered_map allocate every element
+ * separately. Going through malloc for each of them costs time, and memory
+ * for the allocator's bookkeeping of every block. This resource instead
+ * hands out consecutive pieces of larger chunks, and keeps freed pieces in a
+ * free list per size, from which later allocations of the same size are
+ * served first. Chunks are only returned to the system when the resource is
+ * destroyed. The first chunk is FIRST_CHUNK_SIZE_BYTES, and every next one is
+ * twice as large up to MAX_CHUNK_SIZE_BYTES, so that short-lived containers
+ * with few elements stay small.
+ *
+ * Allocations larger than MAX_BLOCK_SIZE_BYTES, or with an alignment stricter
+ * than ALIGN_BYTES, go to the global operator new. All sizes are rounded up to
+ * a multiple of ALIGN_BYTES.
+ *
+ * As all memory comes from chunks of a known size, its usage can be reported
+ * exactly instead of estimated.
+ */
+template <size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= sizeof(void*), "ALIGN_BYTES must fit a free list pointer");
+
+public:
+    static const size_t FIRST_CHUNK_SIZE_BYTES = 4 * 1024;
+    static const size_t MAX_CHUNK_SIZE_BYTES = 256 * 1024;
+
+private:
+    static_assert(FIRST_CHUNK_SIZE_BYTES % ALIGN_BYTES == 0, "chunks must be a multiple of ALIGN_BYTES");
+    static_assert(MAX_BLOCK_SIZE_BYTES <= FIRST_CHUNK_SIZE_BYTES, "every pooled allocation must fit a chunk");
+
+    //! Free pieces are linked through their first bytes.
+    struct ListNode {
+        ListNode* next;
+    };
+
+    //! Heads of the free lists, indexed by size in units of ALIGN_BYTES.
+    ListNode* m_free_lists[MAX_BLOCK_SIZE_BYTES / ALIGN_BYTES + 1];
+    std::vector<void*> m_chunks;
+    //! Unused remainder of the current chunk.
+    char* m_available_begin;
+    char* m_available_end;
+    //! Size of the next chunk to allocate.
+    size_t m_next_chunk_size;
+    //! Bytes held in chunks.
+    size_t m_bytes_allocated;
+    //! Bytes handed out from chunks and not freed yet.
+    size_t m_bytes_in_use;
+
+    static size_t NumUnits(size_t bytes)
+    {
+        return (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    static bool IsPooled(size_t bytes, size_t alignment)
+    {
+        return bytes > 0 && bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ALIGN_BYTES;
+    }
+
+    void Push(void* p, size_t units)
+    {
+        ListNode* node = new (p) ListNode;
+        node->next = m_free_lists[units];
+        m_free_lists[units] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // Don't waste the rest of the current chunk: it is a multiple of ALIGN_BYTES.
+        size_t remaining = m_available_end - m_available_begin;
+        if (remaining > 0) {
+            Push(m_available_begin, remaining / ALIGN_BYTES);
+        }
+        m_chunks.reserve(m_chunks.size() + 1);
+        char* chunk = static_cast<char*>(::operator new(m_next_chunk_size));
+        m_chunks.push_back(chunk);
+        m_available_begin = chunk;
+        m_available_end = chunk + m_next_chunk_size;
+        m_bytes_allocated += m_next_chunk_size;
+        if (m_next_chunk_size < MAX_CHUNK_SIZE_BYTES) {
+            m_next_chunk_size *= 2;
+        }
+    }
+
+public:
+    PoolResource() : m_available_begin(nullptr), m_available_end(nullptr), m_next_chunk_size(FIRST_CHUNK_SIZE_BYTES), m_bytes_allocated(0), m_bytes_in_use(0)
+    {
+        for (ListNode*& head : m_free_lists) {
+            head = nullptr;
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (void* chunk : m_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) {
+            assert(alignment <= alignof(std::max_align_t));
+            return ::operator new(bytes);
+        }
+        const size_t units = NumUnits(bytes);
+        m_bytes_in_use += units * ALIGN_BYTES;
+        if (m_free_lists[units]) {
+            ListNode* node = m_free_lists[units];
+            m_free_lists[units] = node->next;
+            return node;
+        }
+        if ((size_t)(m_available_end - m_available_begin) < units * ALIGN_BYTES) {
+            AllocateChunk();
+        }
+        void* p = m_available_begin;
+        m_available_begin += units * ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        const size_t units = NumUnits(bytes);
+        m_bytes_in_use -= units * ALIGN_BYTES;
+        Push(p, units);
+    }
+
+    //! Bytes of pooled allocations currently in use.
+    size_t BytesInUse() const { return m_bytes_in_use; }
+
+    //! Bytes held in chunks, including freed pieces waiting to be reused.
+    size_t BytesAllocated() const { return m_bytes_allocated; }
+};
+
+/**
+ * Allocator backed by a PoolResource, for node based containers.
+ *
+ * Every container gets its own resource: a default constructed allocator
+ * creates one, copies and rebound allocators share it. The allocator moves
+ * along with the contents when containers are moved or swapped, so memory is
+ * always returned to the resource it came from.
+ */
+template <class T, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+class PoolAllocator
+{
+public:
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+private:
+    std::shared_ptr<ResourceType> m_resource;
+
+    template <class U, size_t M, size_t A>
+    friend class PoolAllocator;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <class U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() : m_resource(std::make_shared<ResourceType>()) {}
+
+    // No move constructor: a moved-from container must still be able to allocate.
+    PoolAllocator(const PoolAllocator& other) noexcept = default;
+    PoolAllocator& operator=(const PoolAllocator& other) noexcept = default;
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.m_resource) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    //! A copy of a container gets a resource of its own.
+    PoolAllocator select_on_container_copy_construction() const
+    {
+        return PoolAllocator();
+    }
+
+    ResourceType* resource() const { return m_resource.get(); }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) const
+    {
+        return m_resource == other.m_resource;
+    }
+
+    template <class U>
+    bool operator!=(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
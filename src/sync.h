@@ -8,10 +8,14 @@
 
 #include <threadsafety.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <thread>
 #include <mutex>
 
+#include <stdint.h>
+
 
 ////////////////////////////////////////////////
 //                                            //
@@ -94,6 +98,13 @@ void static inline DeleteLock(void* cs) {}
 class CCriticalSection : public AnnotatedMixin<std::recursive_mutex>
 {
 public:
+#ifdef DEBUG_LOCKCONTENTION
+    //! Number of times LOCK had to wait for another thread to release this lock.
+    std::atomic<uint64_t> nContentions{0};
+    //! Total time LOCK waited for it, in microseconds.
+    std::atomic<uint64_t> nContentionMicros{0};
+#endif
+
     ~CCriticalSection() {
         DeleteLock((void*)this);
     }
@@ -124,10 +135,13 @@ private:
 #ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
-#endif
+            const auto start = std::chrono::steady_clock::now();
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            lock.mutex()->nContentions++;
+            lock.mutex()->nContentionMicros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
         }
+#else
+        lock.lock();
 #endif
     }
 
@@ -4,9 +4,12 @@
 
 #include <util.h>
 
+#include <support/allocators/pool.h>
 #include <support/allocators/secure.h>
 #include <test/test_bitcoin.h>
 
+#include <unordered_map>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
@@ -231,4 +234,84 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource<64, 8> resource;
+    BOOST_CHECK(resource.BytesInUse() == 0);
+    BOOST_CHECK(resource.BytesAllocated() == 0);
+
+    // Sizes are rounded up to the alignment, and pieces come from one small chunk.
+    void* a = resource.Allocate(20, 4);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK(resource.BytesInUse() == 48);
+    BOOST_CHECK(resource.BytesAllocated() == resource.FIRST_CHUNK_SIZE_BYTES);
+    BOOST_CHECK(static_cast<char*>(b) == static_cast<char*>(a) + 24);
+
+    // Freed pieces are reused for allocations of the same size.
+    resource.Deallocate(a, 20, 4);
+    BOOST_CHECK(resource.BytesInUse() == 24);
+    BOOST_CHECK(resource.Allocate(24, 8) == a);
+    void* c = resource.Allocate(16, 8);
+    BOOST_CHECK(c != a && c != b);
+
+    // Too large or too strictly aligned allocations are not pooled.
+    void* d = resource.Allocate(65, 8);
+    void* e = resource.Allocate(16, 16);
+    BOOST_CHECK(resource.BytesInUse() == 64);
+    resource.Deallocate(d, 65, 8);
+    resource.Deallocate(e, 16, 16);
+    resource.Deallocate(a, 24, 8);
+    resource.Deallocate(b, 24, 8);
+    resource.Deallocate(c, 16, 8);
+    BOOST_CHECK(resource.BytesInUse() == 0);
+
+    // Filling the first chunk allocates one twice as large.
+    std::vector<void*> pieces;
+    for (size_t i = 0; i < resource.FIRST_CHUNK_SIZE_BYTES / 64; i++) {
+        pieces.push_back(resource.Allocate(64, 8));
+    }
+    BOOST_CHECK(resource.BytesAllocated() == 3 * resource.FIRST_CHUNK_SIZE_BYTES);
+
+    // Chunks grow up to MAX_CHUNK_SIZE_BYTES.
+    while (resource.BytesAllocated() < 4 * resource.MAX_CHUNK_SIZE_BYTES) {
+        pieces.push_back(resource.Allocate(64, 8));
+    }
+    const size_t nAllocated = resource.BytesAllocated();
+    for (size_t i = 0; i < resource.MAX_CHUNK_SIZE_BYTES / 64; i++) {
+        pieces.push_back(resource.Allocate(64, 8));
+    }
+    BOOST_CHECK(resource.BytesAllocated() == nAllocated + resource.MAX_CHUNK_SIZE_BYTES);
+    for (void* piece : pieces) {
+        resource.Deallocate(piece, 64, 8);
+    }
+    BOOST_CHECK(resource.BytesInUse() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_tests)
+{
+    typedef PoolAllocator<std::pair<const int, int>, 64, 8> Allocator;
+    typedef std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, Allocator> Map;
+
+    Map map;
+    for (int i = 0; i < 1000; i++) {
+        map[i] = i;
+    }
+    const size_t nInUse = map.get_allocator().resource()->BytesInUse();
+    BOOST_CHECK(nInUse > 0 && nInUse % 1000 == 0);
+
+    // Copies get their own pool, swaps take theirs along.
+    Map copy(map);
+    BOOST_CHECK(copy.get_allocator() != map.get_allocator());
+    BOOST_CHECK(copy.get_allocator().resource()->BytesInUse() == nInUse);
+    Map other;
+    Allocator::ResourceType* resource = map.get_allocator().resource();
+    other.swap(map);
+    BOOST_CHECK(other.get_allocator().resource() == resource);
+    BOOST_CHECK(map.empty());
+    map[0] = 0;
+
+    other.clear();
+    BOOST_CHECK(resource->BytesInUse() == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
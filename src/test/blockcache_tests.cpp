@@ -0,0 +1,75 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+#include <primitives/block.h>
+#include <random.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CBlock> MakeBlock()
+{
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vin[0].scriptSig.resize(100);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+    pblock->vtx.push_back(MakeTransactionRef(tx));
+    pblock->hashPrevBlock = InsecureRand256();
+    return pblock;
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_lru)
+{
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    for (int i = 0; i < 4; i++) {
+        blocks.push_back(MakeBlock());
+    }
+
+    // Find out how much one block takes, and make room for three.
+    size_t nBlockUsage;
+    {
+        CBlockCache cache(1 << 20);
+        cache.Add(blocks[0]->GetHash(), blocks[0]);
+        nBlockUsage = cache.GetStats().nUsage;
+        BOOST_CHECK(nBlockUsage > 0);
+    }
+    CBlockCache cache(3 * nBlockUsage);
+
+    BOOST_CHECK(!cache.Get(blocks[0]->GetHash()));
+    for (int i = 0; i < 3; i++) {
+        cache.Add(blocks[i]->GetHash(), blocks[i]);
+    }
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 3U);
+
+    // Using block 0 makes block 1 the least recently used, which goes first.
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    cache.Add(blocks[3]->GetHash(), blocks[3]);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBlocks, 3U);
+    BOOST_CHECK(!cache.Get(blocks[1]->GetHash()));
+    BOOST_CHECK(cache.Get(blocks[0]->GetHash()) == blocks[0]);
+    BOOST_CHECK(cache.Get(blocks[2]->GetHash()) == blocks[2]);
+    BOOST_CHECK(cache.Get(blocks[3]->GetHash()) == blocks[3]);
+
+    // Adding a block again doesn't count it twice.
+    cache.Add(blocks[3]->GetHash(), blocks[3]);
+    CBlockCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBlocks, 3U);
+    BOOST_CHECK(stats.nUsage <= stats.nMaxUsage);
+    BOOST_CHECK_EQUAL(stats.nHits, 4U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+
+    // A block that doesn't fit at all isn't cached, and doesn't evict anything.
+    CBlockCache small(nBlockUsage - 1);
+    small.Add(blocks[0]->GetHash(), blocks[0]);
+    BOOST_CHECK_EQUAL(small.GetStats().nBlocks, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
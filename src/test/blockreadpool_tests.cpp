@@ -0,0 +1,141 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockreadpool.h>
+#include <chainparams.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Lets the jobs of a test wait until the test opens it.
+class Gate
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fOpen = false;
+
+public:
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this]{ return fOpen; });
+    }
+
+    void Open()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fOpen = true;
+        }
+        cond.notify_all();
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(blockreadpool_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockreadpool_order_per_requester)
+{
+    const int nRequesters = 3;
+    const int nJobs = 50;
+    std::mutex cs;
+    std::vector<std::vector<int>> done(nRequesters);
+    std::vector<int> running(nRequesters, 0);
+    bool fOverlap = false;
+    {
+        CBlockReadPool pool(4);
+        for (int i = 0; i < nJobs; i++) {
+            for (int id = 0; id < nRequesters; id++) {
+                pool.Queue(id, [&, id, i] {
+                    {
+                        std::lock_guard<std::mutex> lock(cs);
+                        if (running[id]++ > 0) fOverlap = true;
+                    }
+                    std::this_thread::yield();
+                    std::lock_guard<std::mutex> lock(cs);
+                    running[id]--;
+                    done[id].push_back(i);
+                });
+            }
+        }
+        // The destructor runs the jobs still queued.
+    }
+
+    // The jobs of a requester run one at a time, in the order they were queued.
+    BOOST_CHECK(!fOverlap);
+    for (int id = 0; id < nRequesters; id++) {
+        BOOST_REQUIRE_EQUAL(done[id].size(), (size_t)nJobs);
+        for (int i = 0; i < nJobs; i++) {
+            BOOST_CHECK_EQUAL(done[id][i], i);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockreadpool_pending_and_turns)
+{
+    CBlockReadPool pool(1);
+    Gate gate;
+    std::mutex cs;
+    std::vector<NodeId> order;
+    auto job = [&](NodeId id) {
+        return [&, id] {
+            gate.Wait();
+            std::lock_guard<std::mutex> lock(cs);
+            order.push_back(id);
+        };
+    };
+
+    // A peer with MAX_BLOCK_READS_PER_PEER reads queued, the most ProcessGetData
+    // allows, and another peer asking for one block after it.
+    for (size_t i = 0; i < MAX_BLOCK_READS_PER_PEER; i++) {
+        pool.Queue(1, job(1));
+    }
+    pool.Queue(2, job(2));
+    BOOST_CHECK_EQUAL(pool.Pending(1), MAX_BLOCK_READS_PER_PEER);
+    BOOST_CHECK_EQUAL(pool.Pending(2), 1U);
+    BOOST_CHECK_EQUAL(pool.Pending(3), 0U);
+
+    // Once the jobs can finish, the second peer doesn't wait for all the
+    // reads of the first one.
+    gate.Open();
+    std::promise<void> promise;
+    pool.Queue(1, [&] { promise.set_value(); });
+    promise.get_future().wait();
+    BOOST_CHECK_EQUAL(pool.Pending(2), 0U);
+    BOOST_REQUIRE_EQUAL(order.size(), MAX_BLOCK_READS_PER_PEER + 1);
+    BOOST_CHECK_EQUAL(order[0], 1);
+    BOOST_CHECK_EQUAL(order[1], 2);
+    BOOST_CHECK_EQUAL(std::count(order.begin(), order.end(), 1), (long)MAX_BLOCK_READS_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(blockreadpool_read_block)
+{
+    CDiskBlockPos pos;
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        pos = chainActive[50]->GetBlockPos();
+        hash = chainActive[50]->GetBlockHash();
+    }
+
+    CBlockReadPool pool(2);
+    CBlock block;
+    BOOST_CHECK(pool.ReadBlock(block, pos, hash, Params().GetConsensus()));
+    BOOST_CHECK(block.GetHash() == hash);
+
+    // The block at pos isn't the one asked for.
+    BOOST_CHECK(!pool.ReadBlock(block, pos, InsecureRand256(), Params().GetConsensus()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -302,6 +302,37 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_UniqueCheck)
     tg.join_all();
 }
 
+// Test that every check is done exactly once with more workers than there
+// are queues, so that some of them share a queue, and over several rounds.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_ManyWorkers)
+{
+    auto queue = std::unique_ptr<Unique_Queue>(new Unique_Queue {QUEUE_BATCH_SIZE});
+    boost::thread_group tg;
+    for (unsigned int x = 0; x < Unique_Queue::MAX_QUEUES + 3; ++x) {
+       tg.create_thread([&]{queue->Thread();});
+    }
+
+    for (size_t round = 0; round < 10; ++round) {
+        UniqueCheck::results.clear();
+        size_t COUNT = 10000;
+        size_t total = COUNT;
+        {
+            CCheckQueueControl<UniqueCheck> control(queue.get());
+            while (total) {
+                size_t r = InsecureRandRange(300);
+                std::vector<UniqueCheck> vChecks;
+                for (size_t k = 0; k < r && total; k++)
+                    vChecks.emplace_back(--total);
+                control.Add(vChecks);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(UniqueCheck::results.size(), COUNT);
+        for (size_t i = 0; i < COUNT; ++i)
+            BOOST_REQUIRE_EQUAL(UniqueCheck::results.count(i), 1);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
 
 // Test that blocks which might allocate lots of memory free their memory aggressively.
 //
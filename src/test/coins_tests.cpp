@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <coins.h>
+#include <coinswritebehind.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <utilstrencodings.h>
@@ -11,8 +13,10 @@
 #include <validation.h>
 #include <consensus/validation.h>
 
-#include <vector>
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -33,6 +37,7 @@ bool operator==(const Coin &a, const Coin &b) {
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
+    MuHash3072 muhash_;
     std::map<COutPoint, Coin> map_;
 
 public:
@@ -52,9 +57,11 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    MuHash3072 GetMuHash() const override { return muhash_; }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase = true) override
     {
-        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
                 map_[it->first] = it->second.coin;
@@ -63,10 +70,10 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
+        muhash_ = muhash;
         return true;
     }
 };
@@ -120,6 +127,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool found_an_entry = false;
     bool missed_an_entry = false;
     bool uncached_an_entry = false;
+    bool synced_a_cache = false;
+    bool evicted_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<COutPoint, Coin> result;
@@ -207,12 +216,22 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         }
 
         if (InsecureRandRange(100) == 0) {
-            // Every 100 iterations, flush an intermediate cache
+            // Every 100 iterations, flush or sync an intermediate cache
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    BOOST_CHECK(stack[flushIndex]->Sync());
+                    synced_a_cache = true;
+                }
             }
         }
+        if (InsecureRandRange(100) == 0) {
+            // Every 100 iterations, evict from a random cache
+            CCoinsViewCacheTest* cache = stack[InsecureRandRange(stack.size())];
+            evicted_an_entry |= cache->Evict(cache->InUseMemoryUsage() / 2) > 0;
+        }
         if (InsecureRandRange(100) == 0) {
             // Every 100 iterations, change the cache stack.
             if (stack.size() > 0 && InsecureRandBool() == 0) {
@@ -253,6 +272,8 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
     BOOST_CHECK(uncached_an_entry);
+    BOOST_CHECK(synced_a_cache);
+    BOOST_CHECK(evicted_an_entry);
 }
 
 // Store of all necessary tx and undo data for next test
@@ -588,7 +609,7 @@ void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
     CCoinsMap map;
     InsertCoinsMapEntry(map, value, flags);
-    view.BatchWrite(map, {});
+    view.BatchWrite(map, {}, {});
 }
 
 class SingleEntryCacheTest
@@ -855,4 +876,326 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_sync_evict)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; i++) {
+        COutPoint outpoint(InsecureRand256(), 0);
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+        outpoints.push_back(outpoint);
+    }
+    cache.SpendCoin(outpoints[0]);
+    cache.SetBestBlock(InsecureRand256());
+
+    // Sync writes everything, but keeps the unspent coins as clean entries.
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), outpoints.size() - 1);
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    cache.SelfTest();
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoints[1], coin) && !coin.IsSpent());
+    BOOST_CHECK(!(base.GetCoin(outpoints[0], coin) && !coin.IsSpent()));
+
+    // Entries used since the last eviction pass survive the first time around.
+    const uint64_t nHits = cache.GetHits();
+    cache.AccessCoin(outpoints[1]);
+    BOOST_CHECK_EQUAL(cache.GetHits(), nHits + 1);
+    for (auto& entry : cache.map()) {
+        entry.second.used = entry.first == outpoints[1];
+    }
+    // All entries have the same size, and their memory is accounted for exactly.
+    const size_t nEntryUsage = cache.map().get_allocator().resource()->BytesInUse() / cache.GetCacheSize();
+    BOOST_CHECK_EQUAL(nEntryUsage * cache.GetCacheSize(), cache.map().get_allocator().resource()->BytesInUse());
+    BOOST_CHECK_EQUAL(cache.Evict(cache.InUseMemoryUsage() - (outpoints.size() - 2) * nEntryUsage), outpoints.size() - 2);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[1]));
+    cache.SelfTest();
+
+    // Modified entries are never evicted.
+    Coin newcoin;
+    newcoin.out.nValue = 1;
+    cache.AddCoin(outpoints[2], std::move(newcoin), false);
+    BOOST_CHECK_EQUAL(cache.Evict(0), 1);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[2]));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict_reuses_memory)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    // Enough coins to take several pool chunks.
+    const size_t nChunkSize = CCoinsMapAllocator::ResourceType::MAX_CHUNK_SIZE_BYTES;
+    while (cache.map().get_allocator().resource()->BytesAllocated() < 8 * nChunkSize) {
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript()), 1, false), false);
+    }
+    const unsigned int nCoins = cache.GetCacheSize();
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+    const size_t nUsage = cache.DynamicMemoryUsage();
+
+    // Evicted entries leave their memory in the pool, where it is not counted
+    // as in use...
+    BOOST_CHECK(cache.Evict(nUsage / 4) > 0);
+    BOOST_CHECK(cache.InUseMemoryUsage() <= nUsage / 4);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nUsage);
+    BOOST_CHECK(cache.GetCacheSize() > 0);
+    cache.SelfTest();
+
+    // ...and is reused for new entries before the pool grows.
+    while (cache.GetCacheSize() < nCoins) {
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript()), 1, false), false);
+    }
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), nUsage);
+    cache.SelfTest();
+}
+
+//! CCoinsViewTest whose writes wait until they are let through.
+class CCoinsViewGated : public CCoinsViewTest
+{
+    std::mutex cs;
+    std::condition_variable cond;
+    bool fOpen = false;
+
+public:
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase = true) override
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            cond.wait(lock, [this]{ return fOpen; });
+        }
+        return CCoinsViewTest::BatchWrite(mapCoins, hashBlock, muhash, erase);
+    }
+
+    void Open()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fOpen = true;
+        }
+        cond.notify_all();
+    }
+};
+
+BOOST_AUTO_TEST_CASE(ccoins_write_behind_usage)
+{
+    CCoinsViewGated base;
+    CCoinsViewWriteBehind writer(&base);
+    CCoinsViewCache cache(&writer);
+    for (int i = 0; i < 1000; i++) {
+        // Scripts too large to be stored inline take memory of their own.
+        cache.AddCoin(COutPoint(InsecureRand256(), 0), Coin(CTxOut(1, CScript() << std::vector<unsigned char>(100, 0)), 1, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    const size_t nUsage = cache.DynamicMemoryUsage();
+
+    // Flush hands the map over as it is, and all of its memory is accounted
+    // for before anything is written.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), nUsage);
+    base.Open();
+    BOOST_CHECK(writer.Wait());
+    // The written coins are kept until the next write.
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), nUsage);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(writer.DynamicMemoryUsage() < nUsage / 10);
+}
+
+//! CCoinsViewTest that counts the lookups that reach it.
+class CCoinsViewCounting : public CCoinsViewTest
+{
+public:
+    mutable size_t nLookups = 0;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        nLookups++;
+        return CCoinsViewTest::GetCoin(outpoint, coin);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(ccoins_write_behind_generations)
+{
+    CCoinsViewCounting base;
+    CCoinsViewWriteBehind writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; i++) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i, CScript()), 1, false), false);
+    }
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Wait());
+
+    // Written coins are served from the write-behind layer, and move back
+    // into the cache, unmodified.
+    for (size_t i = 0; i < 50; i++) {
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, (CAmount)i);
+    }
+    BOOST_CHECK_EQUAL(base.nLookups, 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 50U);
+
+    // The next flush writes nothing, and drops the coins that were not used.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(cache.HaveCoin(outpoints[10]));
+    BOOST_CHECK_EQUAL(base.nLookups, 0U);
+    BOOST_CHECK(cache.HaveCoin(outpoints[60]));
+    BOOST_CHECK_EQUAL(base.nLookups, 1U);
+
+    // A Sync copies the modified entries into the write-behind layer, so
+    // coins the cache evicts afterwards are still served from there.
+    const COutPoint outpoint(InsecureRand256(), 0);
+    cache.AddCoin(outpoint, Coin(CTxOut(1000, CScript()), 2, false), false);
+    BOOST_CHECK(cache.SpendCoin(outpoints[20]));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(cache.Evict(0) > 0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.AccessCoin(outpoint).out.nValue, 1000);
+    BOOST_CHECK(!cache.HaveCoin(outpoints[20]));
+    BOOST_CHECK_EQUAL(base.nLookups, 1U);
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoint, coin) && coin.out.nValue == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_write_behind)
+{
+    CCoinsViewTest base;
+    CCoinsViewWriteBehind writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    std::vector<COutPoint> outpoints;
+    MuHash3072 muhash;
+    for (int i = 0; i < 1000; i++) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandBits(4));
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        ApplyCoinHash(muhash, outpoint, coin);
+        cache.AddCoin(outpoint, std::move(coin), false);
+        outpoints.push_back(outpoint);
+    }
+    uint256 hash1 = InsecureRand256();
+    cache.SetBestBlock(hash1);
+    cache.SetMuHash(muhash);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(cache.GetCacheSize() == 0);
+
+    // Whether or not the write is done, the coins are visible through the writer.
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+    }
+    // And so is the hash of the coins.
+    unsigned char hash_expected[MuHash3072::OUTPUT_SIZE], hash_actual[MuHash3072::OUTPUT_SIZE];
+    muhash.Finalize(hash_expected);
+    cache.GetMuHash().Finalize(hash_actual);
+    BOOST_CHECK(memcmp(hash_expected, hash_actual, sizeof(hash_actual)) == 0);
+    for (size_t i = 0; i < outpoints.size() / 2; i++) {
+        Coin coin;
+        BOOST_CHECK(cache.SpendCoin(outpoints[i], &coin));
+        RemoveCoinHash(muhash, outpoints[i], coin);
+    }
+    uint256 hash2 = InsecureRand256();
+    cache.SetBestBlock(hash2);
+    cache.SetMuHash(muhash);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(writer.Wait());
+    BOOST_CHECK(base.GetBestBlock() == hash2);
+    muhash.Finalize(hash_expected);
+    base.GetMuHash().Finalize(hash_actual);
+    BOOST_CHECK(memcmp(hash_expected, hash_actual, sizeof(hash_actual)) == 0);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        bool fUnspent = base.GetCoin(outpoints[i], coin) && !coin.IsSpent();
+        BOOST_CHECK(fUnspent == (i >= outpoints.size() / 2));
+    }
+
+    // A non-erasing write leaves the written map as it was.
+    CCoinsMap map;
+    CCoinsCacheEntry& entry = map[outpoints[0]];
+    entry.coin.out.nValue = 1;
+    entry.coin.nHeight = 2;
+    entry.flags = CCoinsCacheEntry::DIRTY;
+    CCoinsViewCache parent(&base);
+    BOOST_CHECK(parent.BatchWrite(map, hash2, MuHash3072(), false));
+    BOOST_CHECK(map.size() == 1 && map.begin()->second.coin.out.nValue == 1);
+    BOOST_CHECK(parent.AccessCoin(outpoints[0]).out.nValue == 1);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_db_walk)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewCache cache(&db);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; i++) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandBits(2));
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), true);
+        outpoints.push_back(outpoint);
+    }
+    // Txids at both ends of the key space.
+    cache.AddCoin(COutPoint(uint256(), 0), Coin(CTxOut(1, CScript()), 1, false), true);
+    outpoints.push_back(COutPoint(uint256(), 0));
+    cache.AddCoin(COutPoint(uint256S("ff"), 0), Coin(CTxOut(1, CScript()), 1, false), true);
+    outpoints.push_back(COutPoint(uint256S("ff"), 0));
+    uint256 hash1 = InsecureRand256();
+    cache.SetBestBlock(hash1);
+    BOOST_CHECK(cache.Flush());
+
+    std::unique_ptr<CDBSnapshot> snapshot = db.GetSnapshot();
+    // Later writes do not show in the snapshot.
+    for (size_t i = 0; i < outpoints.size() / 2; i++) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock(*snapshot) == hash1);
+
+    // The ranges go over every coin exactly once, in the order of a single cursor.
+    std::vector<std::vector<COutPoint>> vRangeKeys(COIN_WALK_RANGES);
+    std::vector<COutPoint> keys;
+    BOOST_CHECK(db.WalkCoins(*snapshot, [&](CCoinsViewCursor& cursor, size_t nRange) {
+        BOOST_CHECK(cursor.GetBestBlock() == hash1);
+        for (; cursor.Valid(); cursor.Next()) {
+            COutPoint key;
+            BOOST_CHECK(cursor.GetKey(key));
+            vRangeKeys[nRange].push_back(key);
+        }
+        return true;
+    }, [&](size_t nRange) {
+        keys.insert(keys.end(), vRangeKeys[nRange].begin(), vRangeKeys[nRange].end());
+    }));
+    BOOST_CHECK_EQUAL(keys.size(), outpoints.size());
+    std::unique_ptr<CCoinsViewCursor> pcursor(db.Cursor(*snapshot, 0, 1));
+    for (const COutPoint& key : keys) {
+        COutPoint expected;
+        BOOST_CHECK(pcursor->Valid() && pcursor->GetKey(expected) && key == expected);
+        pcursor->Next();
+    }
+    BOOST_CHECK(!pcursor->Valid());
+
+    // A failing walk stops the whole walk.
+    BOOST_CHECK(!db.WalkCoins(*snapshot, [&](CCoinsViewCursor& cursor, size_t nRange) {
+        return nRange != 10;
+    }, [&](size_t nRange) {
+        BOOST_CHECK(nRange < 10);
+    }));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,124 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coinsprefetch.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <condition_variable>
+#include <mutex>
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+//! Coins view that has every coin, and records the order in which they were asked for.
+class CCoinsViewRecording : public CCoinsView
+{
+public:
+    mutable std::mutex cs;
+    mutable std::condition_variable cond;
+    mutable std::vector<COutPoint> lookups;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        lookups.push_back(outpoint);
+        coin = Coin(CTxOut(outpoint.n, CScript()), 1, false);
+        cond.notify_all();
+        return true;
+    }
+
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, const MuHash3072& muhash, bool erase) override
+    {
+        mapCoins.clear();
+        return true;
+    }
+
+    //! Wait until outpoint has been looked up.
+    bool WaitForLookup(const COutPoint& outpoint)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return cond.wait_for(lock, std::chrono::seconds(30), [&]{ return std::count(lookups.begin(), lookups.end(), outpoint) > 0; });
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, TestChain100Setup)
+
+// Store a block spending the given outpoints on disk and return its position.
+// The outpoints don't exist, so the block is never connected.
+static CDiskBlockPos StoreBlock(TestChain100Setup& setup, const std::vector<COutPoint>& outpoints)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& outpoint : outpoints) {
+        tx.vin.emplace_back(outpoint);
+    }
+    tx.vout.emplace_back(1, CScript() << OP_TRUE);
+    CBlock block = setup.CreateAndProcessBlock({tx}, CScript() << OP_TRUE);
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(block.GetHash());
+    BOOST_REQUIRE(it != mapBlockIndex.end() && (it->second->nStatus & BLOCK_HAVE_DATA));
+    return it->second->GetBlockPos();
+}
+
+BOOST_AUTO_TEST_CASE(prefetch_order_and_invalidation)
+{
+    // Enough inputs for three batches.
+    std::vector<COutPoint> outpoints;
+    for (size_t i = 0; i < 2 * PREFETCH_BATCH_SIZE + 10; i++) {
+        outpoints.emplace_back(InsecureRand256(), i);
+    }
+    const CDiskBlockPos pos = StoreBlock(*this, outpoints);
+    // With a single worker, jobs run in order, so once the input of a block
+    // queued after the first one is looked up, the first one is done.
+    const COutPoint sentinel(InsecureRand256(), 0);
+    const CDiskBlockPos posSentinel = StoreBlock(*this, {sentinel});
+    const COutPoint sentinel2(InsecureRand256(), 0);
+    const CDiskBlockPos posSentinel2 = StoreBlock(*this, {sentinel2});
+
+    CCoinsViewRecording base;
+    CCoinsViewPrefetch prefetch(&base, Params().GetConsensus(), 1);
+    prefetch.PrefetchBlock(pos);
+    prefetch.PrefetchBlock(posSentinel);
+    BOOST_REQUIRE(base.WaitForLookup(sentinel));
+
+    // The batches are loaded in the order in which the block spends them.
+    {
+        std::lock_guard<std::mutex> lock(base.cs);
+        BOOST_CHECK(std::equal(outpoints.begin(), outpoints.end(), base.lookups.begin()));
+        base.lookups.clear();
+    }
+
+    // Every coin is answered from memory once, then comes from the base view.
+    for (const COutPoint& outpoint : outpoints) {
+        Coin coin;
+        BOOST_CHECK(prefetch.GetCoin(outpoint, coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, outpoint.n);
+    }
+    BOOST_CHECK_EQUAL(prefetch.GetHits(), outpoints.size());
+    BOOST_CHECK_EQUAL(prefetch.GetMisses(), 0U);
+    Coin coin;
+    BOOST_CHECK(prefetch.GetCoin(outpoints[0], coin));
+    BOOST_CHECK_EQUAL(prefetch.GetMisses(), 1U);
+    {
+        std::lock_guard<std::mutex> lock(base.cs);
+        BOOST_CHECK(base.lookups.size() == 1 && base.lookups[0] == outpoints[0]);
+    }
+
+    // Writing to the database drops what was prefetched.
+    prefetch.PrefetchBlock(pos);
+    prefetch.PrefetchBlock(posSentinel2);
+    BOOST_REQUIRE(base.WaitForLookup(sentinel2));
+    CCoinsMap mapCoins;
+    BOOST_CHECK(prefetch.BatchWrite(mapCoins, uint256(), MuHash3072()));
+    BOOST_CHECK(prefetch.GetCoin(outpoints[1], coin));
+    BOOST_CHECK_EQUAL(prefetch.GetHits(), outpoints.size());
+    BOOST_CHECK_EQUAL(prefetch.GetMisses(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
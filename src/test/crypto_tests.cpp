@@ -4,16 +4,20 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <hash.h>
 #include <random.h>
+#include <streams.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
 
+#include <limits>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -268,6 +272,25 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // Hashing in place, as the merkle root computation does, gives the same result.
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -524,6 +547,84 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    MuHash3072 muhash;
+    muhash.Insert(tmp, sizeof(tmp));
+    return muhash;
+}
+
+static uint256 FinalizeMuHash(MuHash3072 muhash)
+{
+    uint256 out;
+    muhash.Finalize(out.begin());
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // The hash does not depend on the order of insertions and removals.
+    uint256 res;
+    int table[4];
+    for (int i = 0; i < 4; ++i) {
+        table[i] = InsecureRandBits(3);
+    }
+    for (int order = 0; order < 4; ++order) {
+        MuHash3072 acc;
+        for (int i = 0; i < 4; ++i) {
+            int t = table[i ^ order];
+            if (t & 4) {
+                acc /= FromInt(t & 3);
+            } else {
+                acc *= FromInt(t & 3);
+            }
+        }
+        uint256 out = FinalizeMuHash(acc);
+        if (order == 0) {
+            res = out;
+        } else {
+            BOOST_CHECK(res == out);
+        }
+    }
+
+    // Removing what was inserted gives the hash of the empty set.
+    MuHash3072 x = FromInt(InsecureRandBits(4));
+    MuHash3072 y = FromInt(InsecureRandBits(4));
+    MuHash3072 z;
+    z *= x;
+    z *= y;
+    z /= x;
+    z /= y;
+    BOOST_CHECK(FinalizeMuHash(z) == FinalizeMuHash(MuHash3072()));
+
+    // Test vector
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    BOOST_CHECK(FinalizeMuHash(acc) == uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // The serialized state carries on where it left off.
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << acc;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc2;
+    ss >> acc2;
+    acc *= FromInt(3);
+    acc2 *= FromInt(3);
+    BOOST_CHECK(FinalizeMuHash(acc) == FinalizeMuHash(acc2));
+
+    // Arithmetic modulo the prime: (p - 1)^2 = 1.
+    Num3072 minus_one;
+    for (int i = 0; i < Num3072::LIMBS; ++i) {
+        minus_one.limbs[i] = std::numeric_limits<Num3072::limb_t>::max();
+    }
+    minus_one.limbs[0] -= Num3072::MAX_PRIME_DIFF;
+    minus_one.Multiply(minus_one);
+    Num3072 one;
+    BOOST_CHECK(memcmp(minus_one.limbs, one.limbs, sizeof(one.limbs)) == 0);
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
@@ -9,6 +9,7 @@
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <list>
 #include <vector>
 
@@ -105,6 +106,63 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(testPool.size(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolLinksTest)
+{
+    // Up to two parent or child links are stored inline, more go to the
+    // heap, which the memory usage has to account for.
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(5);
+    for (int i = 0; i < 5; i++)
+    {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    CMutableTransaction txChild[5];
+    for (int i = 0; i < 5; i++)
+    {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout.hash = txParent.GetHash();
+        txChild[i].vin[0].prevout.n = i;
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 11000LL;
+    }
+
+    CTxMemPool testPool;
+    LOCK(testPool.cs);
+    testPool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    CTxMemPool::txiter parentIt = testPool.mapTx.find(txParent.GetHash());
+    const size_t nUsageParentOnly = testPool.DynamicMemoryUsage();
+
+    for (int i = 0; i < 5; i++)
+    {
+        testPool.addUnchecked(txChild[i].GetHash(), entry.FromTx(txChild[i]));
+    }
+    const CTxMemPoolEntry::Links& children = testPool.GetMemPoolChildren(parentIt);
+    BOOST_CHECK_EQUAL(children.size(), 5U);
+    BOOST_CHECK(memusage::DynamicUsage(children) > 0);
+    for (int i = 0; i < 5; i++)
+    {
+        CTxMemPool::txiter childIt = testPool.mapTx.find(txChild[i].GetHash());
+        BOOST_CHECK_EQUAL(std::count(children.begin(), children.end(), &*childIt), 1);
+        BOOST_CHECK_EQUAL(testPool.GetMemPoolParents(childIt).size(), 1U);
+        BOOST_CHECK(testPool.GetMemPoolParents(childIt)[0] == &*parentIt);
+    }
+
+    // Removing the children frees the links again.
+    for (int i = 0; i < 5; i++)
+    {
+        testPool.removeRecursive(txChild[i]);
+    }
+    BOOST_CHECK(testPool.GetMemPoolChildren(parentIt).empty());
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(testPool.GetMemPoolChildren(parentIt)), 0U);
+    BOOST_CHECK_EQUAL(testPool.DynamicMemoryUsage(), nUsageParentOnly);
+}
+
 template<typename name>
 void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
 {
@@ -12,11 +12,13 @@
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <script/sign.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
 #include <utilstrencodings.h>
+#include <validationinterface.h>
 
 #include <test/test_bitcoin.h>
 
@@ -520,4 +522,134 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// The updater's template for the current tip, once it reflects everything
+// that happened so far.
+static std::shared_ptr<const CBlockTemplate> GetUpdatedTemplate(BlockTemplateUpdater& updater)
+{
+    SyncWithValidationInterfaceQueue();
+    updater.SyncWithUpdates();
+    LOCK(cs_main);
+    unsigned int nTransactionsUpdated;
+    return updater.GetBlockTemplate(chainActive.Tip(), nTransactionsUpdated);
+}
+
+BOOST_FIXTURE_TEST_CASE(blocktemplate_updater, TestChain100Setup)
+{
+    GetMainSignals().RegisterWithMempoolSignals(mempool);
+    std::unique_ptr<BlockTemplateUpdater> updater(new BlockTemplateUpdater(Params()));
+    RegisterValidationInterface(updater.get());
+    const CAmount nSubsidy = GetBlockSubsidy(chainActive.Height() + 1, Params().GetConsensus());
+
+    std::shared_ptr<const CBlockTemplate> ptemplate = GetUpdatedTemplate(*updater);
+    BOOST_CHECK(ptemplate && ptemplate->block.vtx.size() == 1);
+
+    // A coinbase spend and its child are appended as they enter the mempool.
+    const CScript redeemScript = CScript() << OP_TRUE;
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    parent.vout.resize(1);
+    parent.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - CENT;
+    parent.vout[0].scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(coinbaseTxns[0].vout[0].scriptPubKey, parent, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    parent.vin[0].scriptSig << vchSig;
+
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(parent.GetHash(), 0);
+    child.vin[0].scriptSig = CScript() << ToByteVector(redeemScript);
+    child.vout.resize(1);
+    child.vout[0].nValue = parent.vout[0].nValue - CENT;
+    child.vout[0].scriptPubKey = parent.vout[0].scriptPubKey;
+
+    for (const CMutableTransaction& tx : {parent, child}) {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr, nullptr, false, 0));
+    }
+    ptemplate = GetUpdatedTemplate(*updater);
+    BOOST_CHECK(ptemplate && ptemplate->block.vtx.size() == 3);
+    if (ptemplate && ptemplate->block.vtx.size() == 3) {
+        BOOST_CHECK(ptemplate->block.vtx[1]->GetHash() == parent.GetHash());
+        BOOST_CHECK(ptemplate->block.vtx[2]->GetHash() == child.GetHash());
+        BOOST_CHECK_EQUAL(ptemplate->block.vtx[0]->vout[0].nValue, nSubsidy + 2 * CENT);
+        BOOST_CHECK_EQUAL(ptemplate->vTxFees[0], -2 * CENT);
+        // Same coinbase and witness commitment as assembling it from scratch
+        std::unique_ptr<CBlockTemplate> pfresh = BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE);
+        BOOST_CHECK(pfresh->vchCoinbaseCommitment == ptemplate->vchCoinbaseCommitment);
+        BOOST_CHECK(pfresh->block.vtx[0]->GetHash() == ptemplate->block.vtx[0]->GetHash());
+    }
+
+    // Removing the parent takes the child along.
+    {
+        LOCK(mempool.cs);
+        mempool.removeRecursive(parent);
+    }
+    ptemplate = GetUpdatedTemplate(*updater);
+    BOOST_CHECK(ptemplate && ptemplate->block.vtx.size() == 1);
+    if (ptemplate) {
+        BOOST_CHECK_EQUAL(ptemplate->block.vtx[0]->vout[0].nValue, nSubsidy);
+    }
+
+    // A new tip gets a new template.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    ptemplate = GetUpdatedTemplate(*updater);
+    BOOST_CHECK(ptemplate && ptemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+
+    // A transaction paying more than the end of the template isn't appended
+    // after it, but gets in at its place with a rebuild.
+    CreateAndProcessBlock({}, scriptPubKey);
+    auto SpendCoinbase = [&](const CTransaction& coinbase, CAmount nFee) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(coinbase.GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = coinbase.vout[0].nValue - nFee;
+        tx.vout[0].scriptPubKey = GetScriptForDestination(CScriptID(redeemScript));
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(coinbase.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+    const CMutableTransaction low = SpendCoinbase(coinbaseTxns[1], CENT);
+    const CMutableTransaction high = SpendCoinbase(coinbaseTxns[2], 10 * CENT);
+    for (const CMutableTransaction& tx : {low, high}) {
+        {
+            LOCK(cs_main);
+            CValidationState state;
+            BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr, nullptr, false, 0));
+        }
+        ptemplate = GetUpdatedTemplate(*updater);
+    }
+    BOOST_CHECK(ptemplate && ptemplate->block.vtx.size() == 3);
+    if (ptemplate && ptemplate->block.vtx.size() == 3) {
+        BOOST_CHECK(ptemplate->block.vtx[1]->GetHash() == high.GetHash());
+        BOOST_CHECK(ptemplate->block.vtx[2]->GetHash() == low.GetHash());
+        BOOST_CHECK_EQUAL(ptemplate->block.vtx[0]->vout[0].nValue, nSubsidy + 11 * CENT);
+    }
+
+    // Nobody asked for a while: the mempool isn't followed anymore, and the
+    // template is assembled again once somebody does.
+    SetMockTime(GetTime() + BLOCK_TEMPLATE_IDLE_TIMEOUT + 1);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(parent), nullptr, nullptr, false, 0));
+    }
+    BOOST_CHECK(!GetUpdatedTemplate(*updater));
+    ptemplate = GetUpdatedTemplate(*updater);
+    BOOST_CHECK(ptemplate && ptemplate->block.vtx.size() == 4);
+    SetMockTime(0);
+
+    UnregisterValidationInterface(updater.get());
+    updater.reset();
+    GetMainSignals().UnregisterWithMempoolSignals(mempool);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -185,4 +185,21 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(serialized_msg_share)
+{
+    CSerializedNetMsg msg;
+    msg.command = "test";
+    msg.data = {1, 2, 3};
+    const uint256 hash = Hash(msg.data.begin(), msg.data.end());
+
+    CSerializedNetMsg copy1 = msg.Share();
+    CSerializedNetMsg copy2 = msg.Share();
+    BOOST_CHECK(msg.data.empty());
+    BOOST_CHECK(msg.payload);
+    BOOST_CHECK(copy1.payload == msg.payload && copy2.payload == msg.payload);
+    BOOST_CHECK_EQUAL(copy1.command, "test");
+    BOOST_CHECK(msg.payload->data == std::vector<unsigned char>({1, 2, 3}));
+    BOOST_CHECK(memcmp(msg.payload->checksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
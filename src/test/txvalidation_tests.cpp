@@ -8,6 +8,7 @@
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
 #include <script/script.h>
+#include <script/sign.h>
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
@@ -58,4 +59,65 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+/**
+ * Ensure that a package is accepted parents first, whatever its order.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_accept_package, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    auto spend = [&](const CTransaction& prev, CAmount nValue) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev.GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = nValue;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(prev.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+
+    CTransactionRef parent = spend(coinbaseTxns[0], 49 * COIN);
+    CTransactionRef child = spend(*parent, 48 * COIN);
+    CTransactionRef grandchild = spend(*child, 47 * COIN);
+    CTransactionRef orphan = spend(*spend(coinbaseTxns[1], 49 * COIN), 48 * COIN);
+
+    std::vector<MempoolAcceptResult> results = AcceptPackageToMemoryPool(mempool, {grandchild, orphan, child, parent}, 0 /* nAbsurdFee */);
+    BOOST_CHECK_EQUAL(results.size(), 4U);
+    BOOST_CHECK(results[0].fAccepted);
+    BOOST_CHECK(!results[1].fAccepted && results[1].fMissingInputs);
+    BOOST_CHECK(results[2].fAccepted);
+    BOOST_CHECK(results[3].fAccepted);
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+
+    // Sending them again reports them as duplicates.
+    results = AcceptPackageToMemoryPool(mempool, {parent}, 0 /* nAbsurdFee */);
+    BOOST_CHECK(!results[0].fAccepted);
+    BOOST_CHECK_EQUAL(results[0].state.GetRejectCode(), REJECT_DUPLICATE);
+    mempool.clear();
+
+    // A package longer than a chain the mempool could take is refused whole.
+    std::vector<CTransactionRef> chain{parent};
+    while (chain.size() <= MAX_PACKAGE_COUNT) {
+        chain.push_back(spend(*chain.back(), chain.back()->vout[0].nValue - COIN / 100));
+    }
+    results = AcceptPackageToMemoryPool(mempool, chain, 0 /* nAbsurdFee */);
+    BOOST_CHECK_EQUAL(results.size(), MAX_PACKAGE_COUNT + 1);
+    for (const MempoolAcceptResult& result : results) {
+        BOOST_CHECK(!result.fAccepted);
+        BOOST_CHECK_EQUAL(result.state.GetRejectReason(), "package-too-many-transactions");
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+    chain.pop_back();
+    results = AcceptPackageToMemoryPool(mempool, chain, 0 /* nAbsurdFee */);
+    BOOST_CHECK(results.back().fAccepted);
+    BOOST_CHECK_EQUAL(mempool.size(), MAX_PACKAGE_COUNT);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
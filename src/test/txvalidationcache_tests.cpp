@@ -9,6 +9,7 @@
 #include <pubkey.h>
 #include <txmempool.h>
 #include <random.h>
+#include <script/sigcache.h>
 #include <script/standard.h>
 #include <script/sign.h>
 #include <test/test_bitcoin.h>
@@ -91,6 +92,69 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+// Whether the signature of the first input of tx is in the signature cache
+static bool SignatureCached(const CTransaction& tx, const CScript& scriptPubKey)
+{
+    PrecomputedTransactionData txdata(tx);
+    std::vector<uint256> entries;
+    CachingTransactionSignatureChecker checker(&tx, 0, 0, true, txdata, &entries);
+    BOOST_CHECK(VerifyScript(tx.vin[0].scriptSig, scriptPubKey, &tx.vin[0].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, checker));
+    return entries.empty();
+}
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_preverify, TestChain100Setup)
+{
+    // Verifying scripts ahead of AcceptToMemoryPool must not change what it
+    // accepts.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    std::vector<CMutableTransaction> spends(4);
+    for (int i = 0; i < 4; i++) {
+        spends[i].nVersion = 1;
+        spends[i].vin.resize(1);
+        spends[i].vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+        spends[i].vin[0].prevout.n = 0;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = (11 + i)*CENT;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+        // The third one can't be mined yet, the fourth conflicts with the first.
+        if (i == 2) {
+            spends[i].nLockTime = chainActive.Height() + 10;
+            spends[i].vin[0].nSequence = 0;
+        }
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spends[i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spends[i].vin[0].scriptSig << vchSig;
+    }
+    // Make the signature of the second one invalid.
+    spends[1].vout[0].nValue = 10*CENT;
+
+    PreVerifyTransactionScripts(mempool, spends[1], 0);
+    BOOST_CHECK(!ToMemPool(spends[1]));
+    PreVerifyTransactionScripts(mempool, spends[2], 0);
+    BOOST_CHECK(!ToMemPool(spends[2]));
+    PreVerifyTransactionScripts(mempool, spends[0], 0);
+    BOOST_CHECK(ToMemPool(spends[0]));
+    BOOST_CHECK_EQUAL(mempool.size(), 1U);
+    PreVerifyTransactionScripts(mempool, spends[3], 0);
+    BOOST_CHECK(!ToMemPool(spends[3]));
+
+    // Only the signature of the transaction that was accepted was cached.
+    BOOST_CHECK(SignatureCached(spends[0], scriptPubKey));
+    BOOST_CHECK(!SignatureCached(spends[2], scriptPubKey));
+    BOOST_CHECK(!SignatureCached(spends[3], scriptPubKey));
+
+    // Already in the mempool, or spending coins we don't have: nothing to do.
+    PreVerifyTransactionScripts(mempool, spends[0], 0);
+    spends[1].vin[0].prevout.hash = InsecureRand256();
+    PreVerifyTransactionScripts(mempool, spends[1], 0);
+    BOOST_CHECK(!pcoinsTip->HaveCoinInCache(spends[1].vin[0].prevout));
+    mempool.clear();
+}
+
 // Run CheckInputs (using pcoinsTip) on the given transaction, for all script
 // flags.  Test that CheckInputs passes for all flags that don't overlap with
 // the failing_flags argument, but otherwise fails.
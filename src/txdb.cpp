@@ -16,6 +16,10 @@
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 #include <boost/thread.hpp>
 
 static const char DB_COIN = 'C';
@@ -26,9 +30,11 @@ static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
+static const char DB_MUHASH = 'M';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_SNAPSHOT_BASE = 'S';
 
 namespace {
 
@@ -54,7 +60,7 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe, bool fMuHashIn) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), fMuHash(fMuHashIn)
 {
 }
 
@@ -73,6 +79,14 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+MuHash3072 CCoinsViewDB::GetMuHash() const {
+    // Stored along with the block it is the hash of the coins at.
+    std::pair<uint256, MuHash3072> muhash;
+    if (!db.Read(DB_MUHASH, muhash))
+        return MuHash3072();
+    return muhash.second;
+}
+
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     std::vector<uint256> vhashHeadBlocks;
     if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
@@ -81,7 +95,7 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const MuHash3072 &muhash, bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -99,6 +113,12 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
     }
 
+    // The hash of the coins passed in was derived from the stored one, which
+    // is only right if that is the hash of the coins at old_tip. If it is not,
+    // or if it is not kept, drop it, so that it gets computed again on startup.
+    std::pair<uint256, MuHash3072> old_muhash;
+    bool fMuHashValid = fMuHash && (old_tip.IsNull() || (db.Read(DB_MUHASH, old_muhash) && old_muhash.first == old_tip));
+
     // In the first batch, mark the database as being in the middle of a
     // transition from old_tip to hashBlock.
     // A vector is used for future extensibility, as we may want to support
@@ -106,7 +126,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = erase ? mapCoins.erase(it) : std::next(it)) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -116,8 +136,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -135,6 +153,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (fMuHashValid) {
+        batch.Write(DB_MUHASH, std::make_pair(hashBlock, muhash));
+    } else {
+        batch.Erase(DB_MUHASH);
+    }
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
     bool ret = db.WriteBatch(batch);
@@ -166,6 +189,33 @@ bool CBlockTreeDB::ReadReindexing(bool &fReindexing) {
     return true;
 }
 
+bool CCoinsViewDB::WriteSnapshotCoins(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    CDBBatch batch(db);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    uint256 old_tip = GetBestBlock();
+    if (old_tip.IsNull()) {
+        // Continuing an earlier call.
+        std::vector<uint256> old_heads = GetHeadBlocks();
+        if (old_heads.size() == 2) {
+            assert(old_heads[0] == hashBlock);
+            old_tip = old_heads[1];
+        }
+    }
+
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+        CoinEntry entry(&it->first);
+        batch.Write(entry, it->second.coin);
+        if (batch.SizeEstimate() > batch_size) {
+            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            db.WriteBatch(batch);
+            batch.Clear();
+        }
+    }
+    return db.WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
@@ -178,16 +228,115 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
        that restriction.  */
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
-    } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
-    }
+    i->CacheKey();
+    return i;
+}
+
+std::unique_ptr<CDBSnapshot> CCoinsViewDB::GetSnapshot() const
+{
+    return MakeUnique<CDBSnapshot>(db);
+}
+
+uint256 CCoinsViewDB::GetBestBlock(const CDBSnapshot &snapshot) const
+{
+    std::unique_ptr<CDBIterator> pcursor(snapshot.NewIterator());
+    pcursor->Seek(DB_BEST_BLOCK);
+    char key;
+    uint256 hashBestChain;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key != DB_BEST_BLOCK || !pcursor->GetValue(hashBestChain))
+        return uint256();
+    return hashBestChain;
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const CDBSnapshot &snapshot, size_t nRange, size_t nRanges) const
+{
+    // The ranges split the first two bytes of the txid, in the order of the keys.
+    uint32_t nPrefixBegin = 0x10000 * nRange / nRanges;
+    uint32_t nPrefixEnd = 0x10000 * (nRange + 1) / nRanges;
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(snapshot.NewIterator(), GetBestBlock(snapshot), nPrefixEnd);
+    COutPoint begin(uint256(), 0);
+    *begin.hash.begin() = nPrefixBegin >> 8;
+    *(begin.hash.begin() + 1) = nPrefixBegin & 0xff;
+    i->pcursor->Seek(CoinEntry(&begin));
+    i->CacheKey();
     return i;
 }
 
+bool CCoinsViewDB::WalkCoins(const CDBSnapshot &snapshot, const std::function<bool(CCoinsViewCursor&, size_t)> &walk, const std::function<void(size_t)> &merge) const
+{
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_COIN_WALK_THREADS));
+    const size_t nAhead = 2 * nThreads;
+
+    std::mutex cs;
+    std::condition_variable cond;
+    size_t nNext = 0;   // Next range to walk.
+    size_t nMerged = 0; // Number of ranges merged.
+    std::vector<bool> vWalked(COIN_WALK_RANGES, false);
+    bool fFailed = false;
+    bool fStop = false;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t nRange;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cond.wait(lock, [&]{ return fStop || nNext == COIN_WALK_RANGES || nNext < nMerged + nAhead; });
+                if (fStop || nNext == COIN_WALK_RANGES) return;
+                nRange = nNext++;
+            }
+            bool fOk;
+            try {
+                std::unique_ptr<CCoinsViewCursor> pcursor(Cursor(snapshot, nRange, COIN_WALK_RANGES));
+                fOk = walk(*pcursor, nRange);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                fOk = false;
+            }
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                vWalked[nRange] = true;
+                if (!fOk) fFailed = fStop = true;
+            }
+            cond.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    auto join = [&]() {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    };
+
+    try {
+        for (size_t nRange = 0; nRange < COIN_WALK_RANGES; nRange++) {
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cond.wait(lock, [&]{ return fStop || vWalked[nRange]; });
+                if (fStop) break;
+            }
+            merge(nRange);
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                nMerged = nRange + 1;
+            }
+            cond.notify_all();
+        }
+    } catch (...) {
+        join();
+        throw;
+    }
+    join();
+    return !fFailed;
+}
+
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
@@ -216,9 +365,16 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
+    CacheKey();
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
     CoinEntry entry(&keyTmp.second);
     if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else if (0x100U * *keyTmp.second.hash.begin() + *(keyTmp.second.hash.begin() + 1) >= nPrefixEnd) {
+        keyTmp.first = 0; // Past the end of the range
     } else {
         keyTmp.first = entry.key;
     }
@@ -251,6 +407,19 @@ bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
 
+bool CBlockTreeDB::WriteSnapshotBase(const uint256 &hash, uint64_t nChainTx) {
+    return Write(DB_SNAPSHOT_BASE, std::make_pair(hash, nChainTx));
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256 &hash, uint64_t &nChainTx) {
+    std::pair<uint256, uint64_t> base;
+    if (!Read(DB_SNAPSHOT_BASE, base))
+        return false;
+    hash = base.first;
+    nChainTx = base.second;
+    return true;
+}
+
 bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     char ch;
     if (!Read(std::make_pair(DB_FLAG, name), ch))
@@ -424,3 +593,58 @@ bool CCoinsViewDB::Upgrade() {
     LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
     return !ShutdownRequested();
 }
+
+bool CCoinsViewDB::InitMuHash() {
+    if (!fMuHash) {
+        return db.Erase(DB_MUHASH);
+    }
+    uint256 hashBestBlock = GetBestBlock();
+    if (hashBestBlock.IsNull()) {
+        // Either empty, or to be replayed first.
+        return true;
+    }
+    std::pair<uint256, MuHash3072> muhash;
+    if (db.Read(DB_MUHASH, muhash) && muhash.first == hashBestBlock) {
+        return true;
+    }
+
+    LogPrintf("Computing the hash of the UTXO set...\n");
+    uiInterface.ShowProgress(_("Computing UTXO set hash"), 0, false);
+    std::unique_ptr<CDBSnapshot> snapshot = GetSnapshot();
+    muhash = std::make_pair(GetBestBlock(*snapshot), MuHash3072());
+    std::vector<MuHash3072> vRangeHash(COIN_WALK_RANGES);
+    std::vector<int64_t> vRangeCount(COIN_WALK_RANGES, 0);
+    bool fWalked = WalkCoins(*snapshot, [&](CCoinsViewCursor &cursor, size_t nRange) {
+        while (cursor.Valid()) {
+            if (ShutdownRequested()) {
+                return false;
+            }
+            COutPoint key;
+            Coin coin;
+            if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+                return error("%s: unable to read value", __func__);
+            }
+            ApplyCoinHash(vRangeHash[nRange], key, coin);
+            vRangeCount[nRange]++;
+            cursor.Next();
+        }
+        return true;
+    }, [&](size_t nRange) {
+        boost::this_thread::interruption_point();
+        muhash.second *= vRangeHash[nRange];
+        if (nRange % 16 == 0) {
+            uiInterface.ShowProgress(_("Computing UTXO set hash"), (int)(nRange * 100.0 / COIN_WALK_RANGES + 0.5), false);
+        }
+    });
+    if (!fWalked) {
+        // Start over next time if interrupted.
+        return ShutdownRequested();
+    }
+    int64_t count = 0;
+    for (int64_t nRangeCount : vRangeCount) {
+        count += nRangeCount;
+    }
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("Computed the hash of %d coins\n", count);
+    return db.Write(DB_MUHASH, muhash);
+}
@@ -10,7 +10,9 @@
 #include <dbwrapper.h>
 #include <chain.h>
 
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -37,6 +39,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Number of ranges of txids that walks over all coins are split into
+static const size_t COIN_WALK_RANGES = 1024;
+//! Maximum number of threads walking the coins at once
+static const int MAX_COIN_WALK_THREADS = 32;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -68,18 +74,49 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! Whether the hash of the coins is stored with the best block. If not, any stored one is dropped.
+    bool fMuHash;
 public:
-    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool fMuHashIn = false);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
+    MuHash3072 GetMuHash() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, const MuHash3072 &muhash, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Take a consistent view of the coins, to walk them with.
+    std::unique_ptr<CDBSnapshot> GetSnapshot() const;
+    //! Retrieve the block hash whose state snapshot represents.
+    uint256 GetBestBlock(const CDBSnapshot &snapshot) const;
+    //! Get a cursor over the coins in snapshot whose txid is in range nRange out of nRanges equal ranges.
+    CCoinsViewCursor *Cursor(const CDBSnapshot &snapshot, size_t nRange, size_t nRanges) const;
+    /**
+     * Walk all coins in snapshot on several threads, split in COIN_WALK_RANGES
+     * ranges of txids. walk(cursor, range) is called for every range on one of
+     * the threads, and merge(range) on the calling thread for every range, in
+     * order, once it has been walked. Only a limited number of ranges are
+     * walked ahead of the merge, so that whatever is kept per range until it
+     * is merged takes a bounded amount of memory. Returns false as soon as a
+     * walk does, or throws.
+     */
+    bool WalkCoins(const CDBSnapshot &snapshot, const std::function<bool(CCoinsViewCursor&, size_t)> &walk, const std::function<void(size_t)> &merge) const;
+
+    /**
+     * Write coins of a UTXO set snapshot at hashBlock into a database without coins,
+     * erasing them from mapCoins. The database stays marked as being moved to
+     * hashBlock, until a BatchWrite for hashBlock completes the load: if it is
+     * interrupted, ReplayBlocks refuses to continue.
+     */
+    bool WriteSnapshotCoins(CCoinsMap &mapCoins, const uint256 &hashBlock);
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    //! Compute the hash of the coins if it is kept but not stored for the best block,
+    //! as after an older version, or a run without -muhash, wrote the database.
+    //! Returns whether an error occurred.
+    bool InitMuHash();
     size_t EstimateSize() const override;
 };
 
@@ -97,10 +134,14 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn, uint32_t nPrefixEndIn = 0x10000):
+        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn), nPrefixEnd(nPrefixEndIn) {}
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
+    //! The cursor ends before the first txid whose first two bytes are at least this.
+    uint32_t nPrefixEnd;
+
+    void CacheKey();
 
     friend class CCoinsViewDB;
 };
@@ -123,6 +164,8 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    bool WriteSnapshotBase(const uint256 &hash, uint64_t nChainTx);
+    bool ReadSnapshotBase(uint256 &hash, uint64_t &nChainTx);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -17,6 +17,7 @@
 #include <coins.h>
 #include <indirectmap.h>
 #include <policy/feerate.h>
+#include <prevector.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
@@ -63,6 +64,11 @@ class CTxMemPool;
 
 class CTxMemPoolEntry
 {
+public:
+    /** In-mempool parents or children of an entry. Most transactions have no
+      * more than a couple, which are stored inline. */
+    typedef prevector<2, const CTxMemPoolEntry*> Links;
+
 private:
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
@@ -128,6 +134,15 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+
+    const Links& GetMemPoolParents() const { return parents; }
+    const Links& GetMemPoolChildren() const { return children; }
+
+private:
+    friend class CTxMemPool;
+    // Maintained by CTxMemPool while the entry is in mapTx
+    mutable Links parents;
+    mutable Links children;
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -364,7 +379,7 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
+ * the in-mempool direct parents and direct children in each entry.  Within
  * each CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -397,7 +412,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -474,19 +489,12 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const CTxMemPoolEntry::Links& GetMemPoolParents(txiter entry) const;
+    const CTxMemPoolEntry::Links& GetMemPoolChildren(txiter entry) const;
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
-    };
-
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
-
+    void UpdateLinks(CTxMemPoolEntry::Links& links, const CTxMemPoolEntry& entry, bool add);
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
@@ -644,7 +652,8 @@ private:
     void UpdateForDescendants(txiter updateIt,
             cacheMap &cachedDescendants,
             const std::set<uint256> &setExclude);
-    /** Update ancestors of hash to add/remove it as a descendant transaction. */
+    /** Update ancestors of hash to add/remove it as a descendant transaction.
+     *  When adding, also link it as a child of its parents. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
@@ -27,6 +27,9 @@
 
 #define _POSIX_C_SOURCE 200112L
 
+#include <pthread.h>
+#include <sched.h>
+
 #endif // __linux__
 
 #include <algorithm>
@@ -848,6 +851,24 @@ void RenameThread(const char* name)
 #endif
 }
 
+bool SetThreadAffinity(int nCore)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    const unsigned int nCores = boost::thread::hardware_concurrency();
+    if (nCores == 0) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(nCore % nCores, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    // Prevent warnings for unused parameters...
+    (void)nCore;
+    return false;
+#endif
+}
+
 void SetupEnvironment()
 {
 #ifdef HAVE_MALLOPT_ARENA_MAX
@@ -303,6 +303,12 @@ int GetNumCores();
 
 void RenameThread(const char* name);
 
+/**
+ * Pin the current thread to the given core, modulo the number of cores.
+ * Returns false if that is not supported on this system.
+ */
+bool SetThreadAffinity(int nCore);
+
 /**
  * .. and a wrapper that just calls func once
  */
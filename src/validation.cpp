@@ -10,6 +10,12 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <checkqueue.h>
+#include <blockcache.h>
+#include <blockimport.h>
+#include <blockpipeline.h>
+#include <coinsprefetch.h>
+#include <coinstats.h>
+#include <coinswritebehind.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
@@ -41,6 +47,7 @@
 #include <warnings.h>
 
 #include <future>
+#include <mutex>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -149,6 +156,8 @@ public:
     BlockMap mapBlockIndex;
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
     CBlockIndex *pindexBestInvalid = nullptr;
+    /** The block the chainstate was loaded from a UTXO set snapshot at, if any. Its ancestors may never have been received. */
+    CBlockIndex *pindexSnapshotBase = nullptr;
 
     bool LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree);
 
@@ -171,6 +180,7 @@ public:
     bool ResetBlockFailureFlags(CBlockIndex *pindex);
 
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+    bool LoadTxOutSetSnapshot(const fs::path& path, const uint256& hashAssumed, const CChainParams& chainparams);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
@@ -178,6 +188,8 @@ public:
 
     void UnloadBlockIndex();
 
+    void CheckBlockIndex(const Consensus::Params& consensusParams);
+
 private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace);
     bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions &disconnectpool);
@@ -185,7 +197,6 @@ private:
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block);
     /** Create a new block index entry for a given block hash */
     CBlockIndex * InsertBlockIndex(const uint256& hash);
-    void CheckBlockIndex(const Consensus::Params& consensusParams);
 
     void InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state);
     CBlockIndex* FindMostWorkChain();
@@ -208,6 +219,7 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fTxIndex = false;
+bool fMuHash = DEFAULT_MUHASH;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
@@ -215,6 +227,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int nPrefetchBlocks = DEFAULT_PREFETCH_BLOCKS;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -277,6 +290,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+std::unique_ptr<CCoinsViewPrefetch> pcoinsprefetch;
+std::unique_ptr<CBlockPipeline> pblockpipeline;
+std::unique_ptr<CCoinsViewWriteBehind> pcoinswritebehind;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
@@ -540,6 +556,39 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/** Transactions pre-verified but not yet looked at by AcceptToMemoryPool are forgotten beyond this many */
+static const size_t MAX_PREVERIFIED_TXS = 1000;
+
+/**
+ * Signature cache entries of the valid signatures of pre-verified
+ * transactions, by witness hash. They only go into the signature cache once
+ * AcceptToMemoryPool gets to verifying the scripts of the transaction, so that
+ * transactions it turns down earlier don't fill the cache.
+ */
+static std::mutex cs_preverified;
+static std::map<uint256, std::vector<uint256>> mapPreVerifiedSigs;
+
+static void AddPreVerifiedSigs(const uint256& wtxid, std::vector<uint256>&& entries)
+{
+    std::lock_guard<std::mutex> lock(cs_preverified);
+    if (mapPreVerifiedSigs.size() >= MAX_PREVERIFIED_TXS) {
+        mapPreVerifiedSigs.clear();
+    }
+    mapPreVerifiedSigs[wtxid] = std::move(entries);
+}
+
+static std::vector<uint256> TakePreVerifiedSigs(const uint256& wtxid)
+{
+    std::vector<uint256> entries;
+    std::lock_guard<std::mutex> lock(cs_preverified);
+    auto it = mapPreVerifiedSigs.find(wtxid);
+    if (it != mapPreVerifiedSigs.end()) {
+        entries = std::move(it->second);
+        mapPreVerifiedSigs.erase(it);
+    }
+    return entries;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
@@ -549,6 +598,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
+    const std::vector<uint256> vPreVerifiedSigs = TakePreVerifiedSigs(tx.GetWitnessHash());
 
     if (!CheckTransaction(tx, state))
         return false; // state filled in by CheckTransaction
@@ -892,6 +942,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+        AddSignatureCacheEntries(vPreVerifiedSigs);
         PrecomputedTransactionData txdata(tx);
         if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
@@ -1001,6 +1052,291 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+static unsigned int GetMempoolScriptVerifyFlags(const CChainParams& chainparams)
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!chainparams.RequireStandard()) {
+        scriptVerifyFlags = gArgs.GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
+/** What transactions are checked against before their scripts are pre-verified, taken under cs_main. */
+struct PreVerifyLimits {
+    int nSpendHeight;
+    bool fWitnessEnabled;
+    CFeeRate mempoolMinFee;
+    CFeeRate minRelayFee;
+    CAmount nAbsurdFee;
+    unsigned int scriptVerifyFlags;
+};
+
+static PreVerifyLimits GetPreVerifyLimits(CTxMemPool& pool, const CChainParams& chainparams, const CAmount nAbsurdFee)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(pool.cs);
+    PreVerifyLimits limits;
+    limits.nSpendHeight = chainActive.Height() + 1;
+    limits.fWitnessEnabled = IsWitnessEnabled(chainActive.Tip(), chainparams.GetConsensus());
+    limits.mempoolMinFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    limits.minRelayFee = ::minRelayTxFee;
+    limits.nAbsurdFee = nAbsurdFee;
+    limits.scriptVerifyFlags = GetMempoolScriptVerifyFlags(chainparams);
+    return limits;
+}
+
+/**
+ * Copy the coins spent by tx into spent, from the chain, the mempool or, if
+ * given, package_coins. Returns false if any of them is missing.
+ */
+static bool GetSpentCoins(const CCoinsViewMemPool& viewMemPool, const CTransaction& tx, const std::map<COutPoint, Coin>* package_coins, std::vector<Coin>& spent)
+{
+    AssertLockHeld(cs_main);
+    spent.clear();
+    spent.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        if (package_coins) {
+            auto it = package_coins->find(txin.prevout);
+            if (it != package_coins->end()) {
+                spent.push_back(it->second);
+                continue;
+            }
+        }
+        const bool fCached = pcoinsTip->HaveCoinInCache(txin.prevout);
+        Coin coin;
+        const bool fHave = viewMemPool.GetCoin(txin.prevout, coin);
+        // As in AcceptToMemoryPool, don't let transactions that may not be
+        // accepted fill the coins cache. It reads the coin again if needed.
+        if (!fCached)
+            pcoinsTip->Uncache(txin.prevout);
+        if (!fHave)
+            return false;
+        spent.push_back(std::move(coin));
+    }
+    return true;
+}
+
+/**
+ * The checks of AcceptToMemoryPool against conflicting mempool transactions
+ * that can be made before verifying scripts: each of them must signal
+ * replaceability and pay a lower feerate than tx, which must pay more than
+ * them and their descendants. Descendants shared by several of them are
+ * counted more than once, which at worst skips the pre-verification.
+ */
+static bool CheckMempoolConflicts(const CTxMemPool& pool, const CTransaction& tx, const std::vector<Coin>& spent, const CAmount nFeeDelta)
+{
+    AssertLockHeld(pool.cs);
+    CAmount nValueIn = 0;
+    for (const Coin& coin : spent) {
+        nValueIn += coin.out.nValue;
+        if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
+            return false;
+    }
+    const CAmount nModifiedFees = nValueIn - tx.GetValueOut() + nFeeDelta;
+    const CFeeRate newFeeRate(nModifiedFees, GetVirtualTransactionSize(tx));
+    std::set<uint256> setConflicts;
+    CAmount nConflictingFees = 0;
+    for (const CTxIn& txin : tx.vin) {
+        auto itConflicting = pool.mapNextTx.find(txin.prevout);
+        if (itConflicting == pool.mapNextTx.end())
+            continue;
+        const CTransaction* ptxConflicting = itConflicting->second;
+        if (!setConflicts.insert(ptxConflicting->GetHash()).second)
+            continue;
+        if (!fEnableReplacement || !SignalsOptInRBF(*ptxConflicting))
+            return false;
+        CTxMemPool::txiter mi = pool.mapTx.find(ptxConflicting->GetHash());
+        if (mi == pool.mapTx.end())
+            continue;
+        if (newFeeRate <= CFeeRate(mi->GetModifiedFee(), mi->GetTxSize()))
+            return false;
+        nConflictingFees += mi->GetModFeesWithDescendants();
+    }
+    return nModifiedFees >= nConflictingFees;
+}
+
+/**
+ * Check tx against the coins it spends as AcceptToMemoryPool does, as far as
+ * that is possible with those coins alone, and only if it passes, verify its
+ * scripts. Entries for the valid signatures are kept for AcceptToMemoryPool to
+ * store in the signature cache. CheckTransaction, finality and the mempool
+ * conflicts must have been checked already. Checks that need more of the
+ * chain or the mempool (ancestor limits) are left to AcceptToMemoryPool.
+ */
+static void PreVerifyScripts(const CTransaction& tx, const std::vector<Coin>& spent, const CAmount nFeeDelta, const PreVerifyLimits& limits)
+{
+    if (!gArgs.GetBoolArg("-prematurewitness", false) && tx.HasWitness() && !limits.fWitnessEnabled)
+        return;
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(tx, reason, limits.fWitnessEnabled))
+        return;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        view.AddCoin(tx.vin[i].prevout, Coin(spent[i]), false);
+    }
+    CValidationState state;
+    CAmount nFees = 0;
+    if (!Consensus::CheckTxInputs(tx, state, view, limits.nSpendHeight, nFees))
+        return;
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return;
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return;
+    const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return;
+    const int64_t nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+    const CAmount nModifiedFees = nFees + nFeeDelta;
+    const CAmount mempoolRejectFee = limits.mempoolMinFee.GetFee(nSize);
+    if (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee)
+        return;
+    if (nModifiedFees < limits.minRelayFee.GetFee(nSize))
+        return;
+    if (limits.nAbsurdFee && nFees > limits.nAbsurdFee)
+        return;
+
+    // The signature cache is safe to use from any thread.
+    PrecomputedTransactionData txdata(tx);
+    std::vector<uint256> entries;
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        CachingTransactionSignatureChecker checker(&tx, i, spent[i].out.nValue, false, txdata, &entries);
+        if (!VerifyScript(tx.vin[i].scriptSig, spent[i].out.scriptPubKey, &tx.vin[i].scriptWitness, limits.scriptVerifyFlags, checker))
+            return;
+    }
+    AddPreVerifiedSigs(tx.GetWitnessHash(), std::move(entries));
+}
+
+void PreVerifyTransactionScripts(CTxMemPool& pool, const CTransaction& tx, const CAmount nAbsurdFee)
+{
+    AssertLockNotHeld(cs_main);
+    CValidationState state;
+    if (tx.IsCoinBase() || !CheckTransaction(tx, state))
+        return;
+
+    std::vector<Coin> spent;
+    CAmount nFeeDelta = 0;
+    PreVerifyLimits limits;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        if (pool.exists(tx.GetHash()) || !CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS) ||
+            !GetSpentCoins(viewMemPool, tx, nullptr, spent))
+            return;
+        pool.ApplyDelta(tx.GetHash(), nFeeDelta);
+        if (!CheckMempoolConflicts(pool, tx, spent, nFeeDelta))
+            return;
+        limits = GetPreVerifyLimits(pool, Params(), nAbsurdFee);
+    }
+    PreVerifyScripts(tx, spent, nFeeDelta, limits);
+}
+
+std::vector<MempoolAcceptResult> AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, const CAmount nAbsurdFee)
+{
+    AssertLockNotHeld(cs_main);
+    const CChainParams& chainparams = Params();
+    const size_t n = txs.size();
+    std::vector<MempoolAcceptResult> results(n);
+
+    // Don't spend time on packages larger than what the ancestor limits let
+    // into the mempool as one chain anyway.
+    int64_t nPackageSize = 0;
+    for (const CTransactionRef& tx : txs) {
+        nPackageSize += GetVirtualTransactionSize(*tx);
+    }
+    if (n > MAX_PACKAGE_COUNT || nPackageSize > MAX_PACKAGE_SIZE * 1000) {
+        const std::string reason = n > MAX_PACKAGE_COUNT ? "package-too-many-transactions" : "package-too-large";
+        for (MempoolAcceptResult& result : results) {
+            result.state.DoS(0, false, REJECT_NONSTANDARD, reason);
+        }
+        return results;
+    }
+
+    // Order the package so that transactions come after their parents in it.
+    std::map<uint256, size_t> index;
+    for (size_t i = 0; i < n; i++) {
+        index.emplace(txs[i]->GetHash(), i);
+    }
+    std::vector<std::vector<size_t>> children(n);
+    std::vector<size_t> nParents(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        std::set<size_t> parents;
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = index.find(txin.prevout.hash);
+            if (it != index.end() && it->second != i) {
+                parents.insert(it->second);
+            }
+        }
+        for (size_t parent : parents) {
+            children[parent].push_back(i);
+        }
+        nParents[i] = parents.size();
+    }
+    std::vector<size_t> order;
+    order.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (nParents[i] == 0) order.push_back(i);
+    }
+    for (size_t pos = 0; pos < order.size(); pos++) {
+        for (size_t child : children[order[pos]]) {
+            if (--nParents[child] == 0) order.push_back(child);
+        }
+    }
+    // Only a duplicated txid can leave anything out; AcceptToMemoryPool rejects those.
+    for (size_t i = 0; i < n; i++) {
+        if (nParents[i] != 0) order.push_back(i);
+    }
+
+    // Verify the scripts without holding cs_main, as PreVerifyTransactionScripts
+    // does, looking up the coins spent by all the transactions under one lock,
+    // through one view.
+    std::vector<std::vector<Coin>> spent(n);
+    std::vector<CAmount> nFeeDelta(n, 0);
+    std::vector<bool> fHaveSpent(n, false);
+    PreVerifyLimits limits;
+    {
+        LOCK2(cs_main, pool.cs);
+        limits = GetPreVerifyLimits(pool, chainparams, nAbsurdFee);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        std::map<COutPoint, Coin> package_coins;
+        for (size_t i : order) {
+            const CTransaction& tx = *txs[i];
+            CValidationState state;
+            if (!tx.IsCoinBase() && !pool.exists(tx.GetHash()) && CheckTransaction(tx, state) &&
+                CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS)) {
+                pool.ApplyDelta(tx.GetHash(), nFeeDelta[i]);
+                fHaveSpent[i] = GetSpentCoins(viewMemPool, tx, &package_coins, spent[i]) &&
+                                CheckMempoolConflicts(pool, tx, spent[i], nFeeDelta[i]);
+            }
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                package_coins.emplace(COutPoint(tx.GetHash(), o), Coin(tx.vout[o], MEMPOOL_HEIGHT, false));
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (fHaveSpent[i]) {
+            PreVerifyScripts(*txs[i], spent[i], nFeeDelta[i], limits);
+        }
+    }
+
+    LOCK(cs_main);
+    const int64_t nAcceptTime = GetTime();
+    for (size_t i : order) {
+        std::vector<COutPoint> coins_to_uncache;
+        MempoolAcceptResult& result = results[i];
+        result.fAccepted = AcceptToMemoryPoolWorker(chainparams, pool, result.state, txs[i], &result.fMissingInputs, nAcceptTime, nullptr /* plTxnReplaced */, false /* bypass_limits */, nAbsurdFee, coins_to_uncache);
+        if (!result.fAccepted) {
+            for (const COutPoint& hashTx : coins_to_uncache)
+                pcoinsTip->Uncache(hashTx);
+        }
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return results;
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1119,6 +1455,33 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Seek back to the index header written by WriteBlockToDisk
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= 8;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadRawBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    try {
+        CMessageHeader::MessageStartChars blkStart;
+        unsigned int nSize;
+        filein >> FLATDATA(blkStart) >> nSize;
+        if (memcmp(blkStart, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+            return error("ReadRawBlockFromDisk: Block magic mismatch at %s", pos.ToString());
+        if (nSize > MAX_SIZE)
+            return error("ReadRawBlockFromDisk: Block size %u too large at %s", nSize, pos.ToString());
+        block.resize(nSize);
+        filein.read((char*)block.data(), nSize);
+    }
+    catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
@@ -1544,6 +1907,25 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/** Apply the changes a block makes to the UTXO set, given its undo data, to a hash of the set. */
+static void ApplyBlockHash(MuHash3072& muhash, const CBlock& block, const CBlockUndo& blockundo, int nHeight)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                RemoveCoinHash(muhash, tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+        }
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                ApplyCoinHash(muhash, COutPoint(tx.GetHash(), o), Coin(tx.vout[o], nHeight, i == 0));
+            }
+        }
+    }
+}
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
 DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
@@ -1561,6 +1943,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
+    MuHash3072 muhash;
+    if (fMuHash) muhash = view.GetMuHash();
+
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1577,6 +1962,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase) {
                     fClean = false; // transaction output mismatch
                 }
+                // Take out the coin that was there, not the one the block created.
+                if (fMuHash && is_spent) RemoveCoinHash(muhash, out, coin);
             }
         }
 
@@ -1589,9 +1976,15 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
+                if (fMuHash) {
+                    // A coin still there is overwritten, so it leaves the hash.
+                    const Coin& existing = view.AccessCoin(out);
+                    if (!existing.IsSpent()) RemoveCoinHash(muhash, out, existing);
+                }
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
+                if (fMuHash) ApplyCoinHash(muhash, out, view.AccessCoin(out));
             }
             // At this point, all of txundo.vprevout should have been moved out.
         }
@@ -1599,6 +1992,7 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
 
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
+    if (fMuHash) view.SetMuHash(muhash);
 
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
@@ -1669,8 +2063,11 @@ static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& stat
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
-void ThreadScriptCheck() {
+void ThreadScriptCheck(int nCore) {
     RenameThread("bitcoin-scriptch");
+    if (nCore >= 0 && !SetThreadAffinity(nCore)) {
+        LogPrintf("Unable to pin script verification thread to core %d\n", nCore);
+    }
     scriptcheckqueue.Thread();
 }
 
@@ -1861,6 +2258,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     assert(pindex->pprev);
     CBlockIndex *pindexBIP34height = pindex->pprev->GetAncestor(chainparams.GetConsensus().BIP34Height);
     //Only continue to enforce if we're below BIP34 activation height or the block hash at that height doesn't correspond.
+    // The coinbases of the two exceptions replace unspent coins, which have to be taken out of the UTXO set hash.
+    const bool fOverwriteCoinbase = !fEnforceBIP30;
     fEnforceBIP30 = fEnforceBIP30 && (!pindexBIP34height || !(pindexBIP34height->GetBlockHash() == chainparams.GetConsensus().BIP34Hash));
 
     if (fEnforceBIP30) {
@@ -1887,6 +2286,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
+    MuHash3072 muhashOverwritten;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
@@ -1949,6 +2349,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             control.Add(vChecks);
         }
 
+        if (fMuHash && fOverwriteCoinbase && i == 0) {
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                const COutPoint out(tx.GetHash(), o);
+                const Coin& coin = view.AccessCoin(out);
+                if (!coin.IsSpent()) RemoveCoinHash(muhashOverwritten, out, coin);
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -1984,6 +2392,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!WriteTxIndexDataForBlock(block, state, pindex))
         return false;
 
+    // update the hash of the view's coins
+    if (fMuHash) {
+        MuHash3072 muhash = view.GetMuHash();
+        muhash *= muhashOverwritten;
+        ApplyBlockHash(muhash, block, blockundo, pindex->nHeight);
+        view.SetMuHash(muhash);
+    }
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2043,12 +2459,18 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastSetChain = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // Memory of evicted coins is reused for new ones, so only what is in use counts.
+        int64_t cacheSize = pcoinsTip->InUseMemoryUsage();
+        // Coins handed to the write-behind layer count towards the limit too.
+        int64_t cacheSizeTotal = cacheSize + (pcoinswritebehind ? pcoinswritebehind->DynamicMemoryUsage() : 0);
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
+        // The write-behind layer keeps the coins of the last flush until the
+        // next one, so then the cache itself gets half of the space.
+        int64_t nCacheSpace = pcoinswritebehind ? nTotalSpace / 2 : nTotalSpace;
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+        bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nCacheSpace) / 10, nCacheSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
         // The cache is over the limit, we have to write now.
-        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
+        bool fCacheCritical = mode == FLUSH_STATE_IF_NEEDED && (cacheSize > nCacheSpace || cacheSizeTotal > nTotalSpace);
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
@@ -2080,9 +2502,12 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files, once no background write may still need them for a replay.
+            if (fFlushForPrune) {
+                if (pcoinswritebehind && !pcoinswritebehind->Wait())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2095,8 +2520,29 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (pcoinswritebehind) {
+                // Hand the whole cache over to be written in the background,
+                // and continue on an empty one. The coins stay available from
+                // the write-behind layer until the next flush; those used in the
+                // meantime move back into the cache. Flushes for a full cache
+                // complete while validation continues too: Flush only blocks
+                // if the previous one is still being written. Explicit flushes
+                // and pruning need the coins on disk now.
+                if (!pcoinsTip->Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+                if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinswritebehind->Wait())
+                    return AbortNode(state, "Failed to write to coin database");
+            } else {
+                // Write the changes, keeping the unspent coins cached.
+                if (!pcoinsTip->Sync())
+                    return AbortNode(state, "Failed to write to coin database");
+                // Instead of starting over with an empty cache, make room by dropping
+                // the coins that were not used recently.
+                if (fCacheLarge || fCacheCritical) {
+                    size_t nEvicted = pcoinsTip->Evict(nTotalSpace * 3 / 4);
+                    LogPrint(BCLog::COINDB, "Evicted %u coins from the cache, %.1fMiB left\n", nEvicted, pcoinsTip->InUseMemoryUsage() * (1.0 / (1 << 20)));
+                }
+            }
             nLastFlush = nNow;
         }
     }
@@ -2200,11 +2646,18 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 {
     CBlockIndex *pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return AbortNode(state, "Failed to read block");
+    // Read block from disk, unless it was connected or read recently.
+    std::shared_ptr<const CBlock> pblock;
+    if (g_blockcache) {
+        pblock = g_blockcache->Get(pindexDelete->GetBlockHash());
+    }
+    if (!pblock) {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexDelete, chainparams.GetConsensus()))
+            return AbortNode(state, "Failed to read block");
+        pblock = pblockRead;
+    }
+    const CBlock& block = *pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
@@ -2326,10 +2779,16 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        // Take it from the pipeline if it was read and checked in the background.
+        if (pblockpipeline) {
+            pthisBlock = pblockpipeline->Get(pindexNew);
+        }
+        if (!pthisBlock) {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -2349,6 +2808,9 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        if (pcoinsprefetch) {
+            LogPrint(BCLog::BENCH, "  - Prefetched coins: %u hits, %u misses\n", pcoinsprefetch->GetHits(), pcoinsprefetch->GetMisses());
+        }
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2365,6 +2827,10 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     // Update chainActive & related variables.
     chainActive.SetTip(pindexNew);
     UpdateTip(pindexNew, chainparams);
+    // Keep it in memory for the peers, RPC and ZMQ that will ask for it.
+    if (g_blockcache) {
+        g_blockcache->Add(pindexNew->GetBlockHash(), pthisBlock);
+    }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2486,6 +2952,13 @@ bool CChainState::ActivateBestChainStep(CValidationState& state, const CChainPar
 
         // Connect new blocks.
         for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+            // Start loading the inputs of the blocks that follow, while this one is being connected.
+            if (pcoinsprefetch) {
+                pcoinsprefetch->PrefetchAhead(chainActive.Tip(), pindexMostWork, nPrefetchBlocks);
+            }
+            if (pblockpipeline) {
+                pblockpipeline->Schedule(chainActive.Tip(), pindexMostWork);
+            }
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -3264,8 +3737,6 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     if (ppindex)
         *ppindex = pindex;
 
-    CheckBlockIndex(chainparams.GetConsensus());
-
     return true;
 }
 
@@ -3277,7 +3748,9 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            if (!g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex)) {
+            bool accepted = g_chainstate.AcceptBlockHeader(header, state, chainparams, &pindex);
+            g_chainstate.CheckBlockIndex(chainparams.GetConsensus());
+            if (!accepted) {
                 if (first_invalid) *first_invalid = header;
                 return false;
             }
@@ -3320,7 +3793,9 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    if (!AcceptBlockHeader(block, state, chainparams, &pindex))
+    bool accepted_header = AcceptBlockHeader(block, state, chainparams, &pindex);
+    CheckBlockIndex(chainparams.GetConsensus());
+    if (!accepted_header)
         return false;
 
     // Try to process all requested blocks that we don't have, but only
@@ -3673,6 +4148,10 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
 
     boost::this_thread::interruption_point();
 
+    uint256 hashSnapshotBase;
+    uint64_t nSnapshotChainTx = 0;
+    blocktree.ReadSnapshotBase(hashSnapshotBase, nSnapshotChainTx);
+
     // Calculate nChainWork
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
@@ -3700,12 +4179,18 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             } else {
                 pindex->nChainTx = pindex->nTx;
             }
+        } else if (pindex->GetBlockHash() == hashSnapshotBase) {
+            // The chainstate was loaded from a snapshot at this block, so link
+            // the chain from here on as if all its ancestors had been received.
+            pindex->nChainTx = nSnapshotChainTx;
+            pindexSnapshotBase = pindex;
+            LogPrintf("Chain state loaded from a UTXO set snapshot at height %d, the blocks up to it are not validated\n", pindex->nHeight);
         }
         if (!(pindex->nStatus & BLOCK_FAILED_MASK) && pindex->pprev && (pindex->pprev->nStatus & BLOCK_FAILED_MASK)) {
             pindex->nStatus |= BLOCK_FAILED_CHILD;
             setDirtyBlockIndex.insert(pindex);
         }
-        if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && (pindex->nChainTx || pindex->pprev == nullptr))
+        if ((pindex->IsValid(BLOCK_VALID_TRANSACTIONS) || pindex == pindexSnapshotBase) && (pindex->nChainTx || pindex->pprev == nullptr))
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
@@ -3849,6 +4334,11 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        if (g_chainstate.pindexSnapshotBase && pindex->nHeight <= g_chainstate.pindexSnapshotBase->nHeight) {
+            // Blocks up to a snapshot the chainstate was loaded from were never received.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (snapshot base)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -3926,6 +4416,17 @@ bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& i
         // Pass check = true as every addition may be an overwrite.
         AddCoins(inputs, *tx, pindex->nHeight, true);
     }
+
+    if (fMuHash) {
+        // The spent coins may already be gone from the database, so take them from the undo data.
+        CBlockUndo blockundo;
+        if (!UndoReadFromDisk(blockundo, pindex) || blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("ReplayBlock(): failure reading undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+        MuHash3072 muhash = inputs.GetMuHash();
+        ApplyBlockHash(muhash, block, blockundo, pindex->nHeight);
+        inputs.SetMuHash(muhash);
+    }
     return true;
 }
 
@@ -3998,13 +4499,170 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view) {
     return g_chainstate.ReplayBlocks(params, view);
 }
 
+bool CChainState::LoadTxOutSetSnapshot(const fs::path& path, const uint256& hashAssumed, const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: unable to open %s", __func__, path.string());
+    }
+    SnapshotMetadata metadata;
+    std::vector<CBlockHeader> headers;
+    try {
+        file >> metadata >> headers;
+    } catch (const std::exception& e) {
+        return error("%s: unable to read %s: %s", __func__, path.string(), e.what());
+    }
+    if (headers.empty() || headers.back().GetHash() != metadata.hashBlock || metadata.nChainTx == 0) {
+        return error("%s: malformed snapshot for block %s", __func__, metadata.hashBlock.ToString());
+    }
+
+    // The chain parameters also know the number of transactions up to the
+    // base block, -assumeutxo only the hash.
+    uint256 hashTrusted = hashAssumed;
+    uint64_t nTrustedChainTx = 0;
+    if (hashTrusted.IsNull()) {
+        MapAssumedTxOutSets::const_iterator it = chainparams.AssumedTxOutSets().find(metadata.hashBlock);
+        if (it == chainparams.AssumedTxOutSets().end()) {
+            return error("%s: no known UTXO set hash for block %s, use -assumeutxo", __func__, metadata.hashBlock.ToString());
+        }
+        hashTrusted = it->second.hashSerialized;
+        nTrustedChainTx = it->second.nChainTx;
+    }
+    // Refuse a snapshot that claims another hash before writing anything. The
+    // hash of the coins is checked against it once they are read.
+    if (metadata.hashSerialized != hashTrusted) {
+        return error("%s: snapshot hash %s does not match %s", __func__, metadata.hashSerialized.ToString(), hashTrusted.ToString());
+    }
+    if (nTrustedChainTx != 0 && metadata.nChainTx != nTrustedChainTx) {
+        return error("%s: snapshot transaction count %u does not match %u", __func__, metadata.nChainTx, nTrustedChainTx);
+    }
+
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    if (pcursor->Valid()) {
+        return error("%s: the chainstate database is not empty", __func__);
+    }
+    pcursor.reset();
+
+    LogPrintf("Loading UTXO set snapshot at block %s (%u coins) from %s\n", metadata.hashBlock.ToString(), metadata.nCoins, path.string());
+    int64_t nStart = GetTimeMillis();
+
+    // Accept the headers up to the base block as if a peer had sent them.
+    // There is no active chain yet to check the block index against.
+    CValidationState state;
+    CBlockIndex* pindexBase = nullptr;
+    for (const CBlockHeader& header : headers) {
+        if (!AcceptBlockHeader(header, state, chainparams, &pindexBase)) {
+            return error("%s: invalid header %s: %s", __func__, header.GetHash().ToString(), FormatStateMessage(state));
+        }
+    }
+    if (pindexBase->nHeight != (int)headers.size()) {
+        return error("%s: the headers in the snapshot don't lead to block %s", __func__, metadata.hashBlock.ToString());
+    }
+
+    // Stream the coins into the database, in batches of the size of the coins
+    // cache, hashing them the same way as gettxoutsetinfo does. The rolling
+    // hash of the set is computed along the way, with -muhash.
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata.hashBlock;
+    CCoinsStats stats;
+    MuHash3072 muhash;
+    CCoinsMap mapCoins;
+    try {
+        while (stats.nTransactionOutputs < metadata.nCoins) {
+            if (ShutdownRequested()) {
+                return false;
+            }
+            uint256 txid;
+            uint64_t nOutputs;
+            file >> txid >> COMPACTSIZE(nOutputs);
+            if (nOutputs == 0 || nOutputs > metadata.nCoins - stats.nTransactionOutputs) {
+                return error("%s: bad number of outputs for transaction %s", __func__, txid.ToString());
+            }
+            std::map<uint32_t, Coin> outputs;
+            for (uint64_t i = 0; i < nOutputs; i++) {
+                uint32_t n;
+                Coin coin;
+                file >> VARINT(n) >> coin;
+                if (coin.IsSpent() || coin.nHeight > (uint32_t)pindexBase->nHeight || !outputs.emplace(n, std::move(coin)).second) {
+                    return error("%s: bad coin %s:%u", __func__, txid.ToString(), n);
+                }
+            }
+            ApplyStats(stats, ss, txid, outputs);
+            for (auto& output : outputs) {
+                if (fMuHash) ApplyCoinHash(muhash, COutPoint(txid, output.first), output.second);
+                CCoinsCacheEntry& entry = mapCoins[COutPoint(txid, output.first)];
+                entry.coin = std::move(output.second);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+            }
+            if (memusage::DynamicUsage(mapCoins) > (size_t)nCoinCacheUsage) {
+                if (!pcoinsdbview->WriteSnapshotCoins(mapCoins, metadata.hashBlock)) {
+                    return error("%s: failed to write coins", __func__);
+                }
+                LogPrintf("Loaded %u of %u coins\n", stats.nTransactionOutputs, metadata.nCoins);
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: unable to read coins: %s", __func__, e.what());
+    }
+    if (!pcoinsdbview->WriteSnapshotCoins(mapCoins, metadata.hashBlock)) {
+        return error("%s: failed to write coins", __func__);
+    }
+
+    const uint256 hashSerialized = ss.GetHash();
+    if (hashSerialized != hashTrusted) {
+        return error("%s: UTXO set hash %s does not match %s, restart with -reindex-chainstate to discard the loaded coins",
+                     __func__, hashSerialized.ToString(), hashTrusted.ToString());
+    }
+    // Without a trusted transaction count, at least make sure the one in the
+    // snapshot is possible: every block has a coinbase, every transaction with
+    // unspent outputs is counted, and no block holds more transactions than
+    // the smallest ones that fit in it.
+    if (metadata.nChainTx < (uint64_t)pindexBase->nHeight + 1 || metadata.nChainTx < stats.nTransactions ||
+        metadata.nChainTx > ((uint64_t)pindexBase->nHeight + 1) * (MAX_BLOCK_WEIGHT / MIN_TRANSACTION_WEIGHT)) {
+        return error("%s: impossible transaction count %u for block %s, restart with -reindex-chainstate to discard the loaded coins",
+                     __func__, metadata.nChainTx, metadata.hashBlock.ToString());
+    }
+
+    pindexBase->nChainTx = metadata.nChainTx;
+    pindexSnapshotBase = pindexBase;
+    setBlockIndexCandidates.insert(pindexBase);
+    std::vector<const CBlockIndex*> vBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+    setDirtyBlockIndex.clear();
+    if (!pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), nLastBlockFile, vBlocks) ||
+        !pblocktree->WriteSnapshotBase(metadata.hashBlock, metadata.nChainTx)) {
+        return error("%s: failed to write to the block index database", __func__);
+    }
+
+    // Only now that everything else is in place, make the coins the chainstate
+    // at the base block.
+    if (!pcoinsdbview->BatchWrite(mapCoins, metadata.hashBlock, muhash)) {
+        return error("%s: failed to write the best block", __func__);
+    }
+
+    LogPrintf("Loaded UTXO set snapshot at block %s height %d: %u coins, hash %s (%dms), the blocks up to it are not validated\n",
+        metadata.hashBlock.ToString(), pindexBase->nHeight, stats.nTransactionOutputs, hashSerialized.ToString(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadTxOutSetSnapshot(const fs::path& path, const uint256& hashAssumed, const CChainParams& chainparams) {
+    return g_chainstate.LoadTxOutSetSnapshot(path, hashAssumed, chainparams);
+}
+
+const CBlockIndex* GetSnapshotBase() {
+    return g_chainstate.pindexSnapshotBase;
+}
+
 bool CChainState::RewindBlockIndex(const CChainParams& params)
 {
     LOCK(cs_main);
 
     // Note that during -reindex-chainstate we are called with an empty chainActive!
 
-    int nHeight = 1;
+    // Blocks up to a snapshot the chainstate was loaded from were never
+    // received, so they cannot be missing witness data.
+    int nHeight = pindexSnapshotBase && chainActive.Contains(pindexSnapshotBase) ? pindexSnapshotBase->nHeight + 1 : 1;
     while (nHeight <= chainActive.Height()) {
         if (IsWitnessEnabled(chainActive[nHeight - 1], params.GetConsensus()) && !(chainActive[nHeight]->nStatus & BLOCK_OPT_WITNESS)) {
             break;
@@ -4104,6 +4762,7 @@ bool RewindBlockIndex(const CChainParams& params) {
 
 void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
+    pindexSnapshotBase = nullptr;
     g_failed_blocks.clear();
     setBlockIndexCandidates.clear();
 }
@@ -4194,10 +4853,81 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+/** Map of disk positions for blocks with unknown parent (only used for reindex) */
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/**
+ * Import a block read from a block file, or store it for later if its parent
+ * is not known yet. Returns false if importing the current file should stop.
+ */
+static bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, CDiskBlockPos *dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+        if (dbp)
+            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                        head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -4236,69 +4966,11 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetLimit(nBlockPos + nSize);
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                blkdat >> *pblock;
                 nRewind = blkdat.GetPos();
 
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
-
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
-
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                if (!ImportBlock(chainparams, pblock, dbp, nLoaded))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
@@ -4311,6 +4983,37 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+bool LoadBlockFilesParallel(const CChainParams& chainparams, int nThreads)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    int nSkipFile = -1;
+    CBlockFileImporter importer(chainparams, nThreads);
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    while (importer.Next(pblock, pos)) {
+        boost::this_thread::interruption_point();
+
+        // Like LoadExternalBlockFile, give up on the rest of a file after a system error.
+        if (pos.nFile == nSkipFile)
+            continue;
+        if (!pblock) {
+            LogPrintf("%s: Deserialize error at %s\n", __func__, pos.ToString());
+            continue;
+        }
+        try {
+            if (!ImportBlock(chainparams, pblock, &pos, nLoaded))
+                nSkipFile = pos.nFile;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+        }
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from block files in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4361,6 +5064,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (pindex->pprev != nullptr && pindexFirstNotTransactionsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TRANSACTIONS) pindexFirstNotTransactionsValid = pindex;
         if (pindex->pprev != nullptr && pindexFirstNotChainValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != nullptr && pindexFirstNotScriptsValid == nullptr && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
+        if (pindex == pindexSnapshotBase) {
+            // The chainstate was loaded from a snapshot at this block: it and its
+            // descendants are linked as if all its ancestors had been received.
+            pindexFirstMissing = pindexFirstNeverProcessed = nullptr;
+            pindexFirstNotTransactionsValid = pindexFirstNotChainValid = pindexFirstNotScriptsValid = nullptr;
+        }
 
         // Begin: actual consistency checks.
         if (pindex->pprev == nullptr) {
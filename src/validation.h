@@ -12,6 +12,7 @@
 
 #include <amount.h>
 #include <coins.h>
+#include <consensus/validation.h>
 #include <fs.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <policy/feerate.h>
@@ -34,12 +35,14 @@ class CBlockIndex;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
+class CBlockPipeline;
+class CCoinsViewPrefetch;
+class CCoinsViewWriteBehind;
 class CInv;
 class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
-class CValidationState;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -65,6 +68,10 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Maximum number of transactions in a package given to AcceptPackageToMemoryPool */
+static const unsigned int MAX_PACKAGE_COUNT = DEFAULT_ANCESTOR_LIMIT;
+/** Maximum total virtual size of the transactions in a package, in kilobytes */
+static const unsigned int MAX_PACKAGE_SIZE = DEFAULT_ANCESTOR_SIZE_LIMIT;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** Maximum kilobytes for transactions to store for processing during reorg */
@@ -77,9 +84,11 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 32;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -parpin, whether to pin script-checking threads to cores */
+static const bool DEFAULT_SCRIPTCHECK_PIN = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -130,6 +139,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+/** Default for -muhash */
+static const bool DEFAULT_MUHASH = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -169,11 +180,15 @@ extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+/** Whether the rolling hash of the UTXO set is updated with every block connected and disconnected. */
+extern bool fMuHash;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Number of blocks ahead of the tip whose inputs are prefetched (protected by cs_main) */
+extern int nPrefetchBlocks;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -261,6 +276,8 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Import the blocks of all block files for -reindex, reading and checking them on nThreads threads */
+bool LoadBlockFilesParallel(const CChainParams& chainparams, int nThreads);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -270,8 +287,8 @@ bool LoadBlockIndex(const CChainParams& chainparams);
 bool LoadChainTip(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex();
-/** Run an instance of the script checking thread */
-void ThreadScriptCheck();
+/** Run a script-checking thread, pinned to core nCore unless it is negative. */
+void ThreadScriptCheck(int nCore);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -309,6 +326,39 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** The outcome of offering one transaction of a package to the memory pool. */
+struct MempoolAcceptResult {
+    bool fAccepted = false;
+    bool fMissingInputs = false;
+    CValidationState state;
+};
+
+/**
+ * Try to add a package of transactions to the memory pool, under one cs_main
+ * lock, with each transaction after its parents in the package whatever their
+ * order in txs. Each transaction is checked as AcceptToMemoryPool does, and
+ * its scripts are verified beforehand as PreVerifyTransactionScripts does,
+ * spending outputs of the package as needed. Packages of more than
+ * MAX_PACKAGE_COUNT transactions, or of more than MAX_PACKAGE_SIZE kilobytes,
+ * are refused as a whole. Returns a result for each transaction, in the order
+ * of txs. Must be called without cs_main held.
+ */
+std::vector<MempoolAcceptResult> AcceptPackageToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, const CAmount nAbsurdFee);
+
+/**
+ * Verify the scripts of a transaction that is about to be given to
+ * AcceptToMemoryPool, against the coins it spends now, without holding
+ * cs_main while doing so. The cheaper checks of AcceptToMemoryPool that the
+ * spent coins allow (finality, conflicts with the mempool, standardness,
+ * fees, sigops) come first, so that scripts are only verified for
+ * transactions that pass them. The valid signatures are only stored in the
+ * signature cache once AcceptToMemoryPool, which still checks everything under
+ * cs_main, gets to the scripts of the transaction, and then finds them there.
+ * Does nothing if the transaction can't be checked yet. Must be called
+ * without cs_main held.
+ */
+void PreVerifyTransactionScripts(CTxMemPool& pool, const CTransaction& tx, const CAmount nAbsurdFee);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -396,6 +446,8 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Read the serialized block at pos, as written to disk, after checking its index header. */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -428,6 +480,69 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/** Magic bytes at the start of a UTXO set snapshot file. */
+static const unsigned char SNAPSHOT_MAGIC_BYTES[5] = {'u', 't', 'x', 'o', 0xff};
+static const uint16_t SNAPSHOT_VERSION = 1;
+
+/**
+ * Metadata at the start of a UTXO set snapshot file, as written by the
+ * dumptxoutset RPC. It is followed by the headers of the blocks from height 1
+ * up to the base block, and then by the coins, grouped per transaction: the
+ * txid, the number of unspent outputs, and the index and coin of each of them.
+ */
+class SnapshotMetadata
+{
+public:
+    //! Block at which the snapshot was taken.
+    uint256 hashBlock;
+    //! Number of transactions in the chain up to and including that block.
+    uint64_t nChainTx;
+    //! Number of coins in the snapshot.
+    uint64_t nCoins;
+    //! Hash of the UTXO set, as reported by gettxoutsetinfo in hash_serialized_2.
+    uint256 hashSerialized;
+
+    SnapshotMetadata() : nChainTx(0), nCoins(0) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((const char*)SNAPSHOT_MAGIC_BYTES, sizeof(SNAPSHOT_MAGIC_BYTES));
+        s << SNAPSHOT_VERSION << hashBlock << nChainTx << nCoins << hashSerialized;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char magic[sizeof(SNAPSHOT_MAGIC_BYTES)];
+        s.read((char*)magic, sizeof(magic));
+        if (memcmp(magic, SNAPSHOT_MAGIC_BYTES, sizeof(magic)) != 0) {
+            throw std::ios_base::failure("Not a UTXO set snapshot");
+        }
+        uint16_t nVersion;
+        s >> nVersion;
+        if (nVersion != SNAPSHOT_VERSION) {
+            throw std::ios_base::failure("Unsupported UTXO set snapshot version");
+        }
+        s >> hashBlock >> nChainTx >> nCoins >> hashSerialized;
+    }
+};
+
+/**
+ * Load the UTXO set snapshot at path into a coins database without coins, and
+ * make its base block the tip. The hash of the snapshot must match hashAssumed, or
+ * if that is null, the hash and transaction count for the base block in the
+ * chain parameters.
+ *
+ * The blocks up to the base block are not validated, neither now nor later in
+ * the background: there is a single chainstate, so the node keeps trusting the
+ * snapshot until it is reindexed.
+ */
+bool LoadTxOutSetSnapshot(const fs::path& path, const uint256& hashAssumed, const CChainParams& chainparams);
+
+/** The block the chainstate was loaded from a UTXO set snapshot at, or nullptr. Requires cs_main. */
+const CBlockIndex* GetSnapshotBase();
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator);
 
@@ -446,6 +561,15 @@ extern CChain& chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** Global variable that points to the view prefetching coins for pcoinsTip (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewPrefetch> pcoinsprefetch;
+
+/** Global variable that points to the pipeline reading and checking blocks ahead of the tip, if enabled (protected by cs_main) */
+extern std::unique_ptr<CBlockPipeline> pblockpipeline;
+
+/** Global variable that points to the view writing pcoinsTip flushes in the background, if enabled (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewWriteBehind> pcoinswritebehind;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <streams.h>
@@ -172,7 +173,13 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    {
+    std::shared_ptr<const CBlock> pblock;
+    if (g_blockcache) {
+        pblock = g_blockcache->Get(pindex->GetBlockHash());
+    }
+    if (pblock) {
+        ss << *pblock;
+    } else {
         LOCK(cs_main);
         CBlock block;
         if(!ReadBlockFromDisk(block, pindex, consensusParams))
@@ -19,6 +19,7 @@ Tests correspond to code in rpc/blockchain.cpp.
 """
 
 from decimal import Decimal
+import hashlib
 import http.client
 import subprocess
 
@@ -130,6 +131,9 @@ class BlockchainTest(BitcoinTestFramework):
         assert_raises_rpc_error(-8, "Invalid block count: should be between 0 and the block's height - 1", self.nodes[0].getchaintxstats, 201)
 
     def _test_gettxoutsetinfo(self):
+        assert_raises_rpc_error(-1, "restart with -muhash", self.nodes[0].gettxoutsetinfo, "muhash")
+        # The rolling hash is computed on startup, and kept from there on.
+        self.restart_node(0, ['-stopatheight=207', '-prune=550', '-muhash'])
         node = self.nodes[0]
         res = node.gettxoutsetinfo()
 
@@ -144,6 +148,12 @@ class BlockchainTest(BitcoinTestFramework):
         assert size < 64000
         assert_equal(len(res['bestblock']), 64)
         assert_equal(len(res['hash_serialized_2']), 64)
+        res_muhash = node.gettxoutsetinfo("muhash")
+        assert_equal(res_muhash['height'], 200)
+        assert_equal(res_muhash['bestblock'], res['bestblock'])
+        assert_equal(len(res_muhash['muhash']), 64)
+        assert 'txouts' not in res_muhash
+        assert_raises_rpc_error(-8, "Unknown hash_type", node.gettxoutsetinfo, "sha256")
 
         self.log.info("Test that gettxoutsetinfo() works for blockchain with just the genesis block")
         b1hash = node.getblockhash(1)
@@ -157,6 +167,9 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res2['bogosize'], 0),
         assert_equal(res2['bestblock'], node.getblockhash(0))
         assert_equal(len(res2['hash_serialized_2']), 64)
+        # The hash of the empty set: the hash of the number one.
+        empty_muhash = hashlib.sha256(b'\x01' + b'\x00' * 383).digest()[::-1].hex()
+        assert_equal(node.gettxoutsetinfo("muhash")['muhash'], empty_muhash)
 
         self.log.info("Test that gettxoutsetinfo() returns the same result after invalidate/reconsider block")
         node.reconsiderblock(b1hash)
@@ -169,6 +182,9 @@ class BlockchainTest(BitcoinTestFramework):
         assert_equal(res['bogosize'], res3['bogosize'])
         assert_equal(res['bestblock'], res3['bestblock'])
         assert_equal(res['hash_serialized_2'], res3['hash_serialized_2'])
+        res3_muhash = node.gettxoutsetinfo("muhash")
+        assert_equal(res_muhash['bestblock'], res3_muhash['bestblock'])
+        assert_equal(res_muhash['muhash'], res3_muhash['muhash'])
 
     def _test_getblockheader(self):
         node = self.nodes[0]
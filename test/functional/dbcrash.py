@@ -50,7 +50,8 @@ class ChainstateWriteCrashTest(BitcoinTestFramework):
         # Set -maxmempool=0 to turn off mempool memory sharing with dbcache
         # Set -rpcservertimeout=900 to reduce socket disconnects in this
         # long-running test
-        self.base_args = ["-limitdescendantsize=0", "-maxmempool=0", "-rpcservertimeout=900", "-dbbatchsize=200000"]
+        # Set -muhash to check that the rolling UTXO set hash survives the crashes
+        self.base_args = ["-limitdescendantsize=0", "-maxmempool=0", "-rpcservertimeout=900", "-dbbatchsize=200000", "-muhash"]
 
         # Set different crash ratios and cache sizes.  Note that not all of
         # -dbcache goes to pcoinsTip.
@@ -59,7 +60,7 @@ class ChainstateWriteCrashTest(BitcoinTestFramework):
         self.node2_args = ["-dbcrashratio=24", "-dbcache=16"] + self.base_args
 
         # Node3 is a normal node with default args, except will mine full blocks
-        self.node3_args = ["-blockmaxweight=4000000"]
+        self.node3_args = ["-blockmaxweight=4000000", "-muhash"]
         self.extra_args = [self.node0_args, self.node1_args, self.node2_args, self.node3_args]
 
     def setup_network(self):
@@ -175,6 +176,7 @@ class ChainstateWriteCrashTest(BitcoinTestFramework):
 
         Restart any nodes that crash while querying."""
         node3_utxo_hash = self.nodes[3].gettxoutsetinfo()['hash_serialized_2']
+        node3_muhash = self.nodes[3].gettxoutsetinfo("muhash")['muhash']
         self.log.info("Verifying utxo hash matches for all nodes")
 
         for i in range(3):
@@ -184,6 +186,8 @@ class ChainstateWriteCrashTest(BitcoinTestFramework):
                 # probably a crash on db flushing
                 nodei_utxo_hash = self.restart_node(i, self.nodes[3].getbestblockhash())
             assert_equal(nodei_utxo_hash, node3_utxo_hash)
+            # The rolling hash must have been carried through any replays.
+            assert_equal(self.nodes[i].gettxoutsetinfo("muhash")['muhash'], node3_muhash)
 
     def generate_small_transactions(self, node, count, utxo_list):
         FEE = 1000  # TODO: replace this with node relay fee based calculation
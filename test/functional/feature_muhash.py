@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the rolling UTXO set hash kept with -muhash.
+
+- Without -muhash, gettxoutsetinfo "muhash" is refused.
+- The hash follows blocks being connected and disconnected.
+- A node that ran without -muhash computes the hash on startup, and agrees
+  with a node that kept it all along.
+"""
+
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, connect_nodes_bi, sync_blocks
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+FEE = 10000
+
+class MuHashTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-muhash"], []]
+
+    def muhash(self, node):
+        return node.gettxoutsetinfo("muhash")["muhash"]
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.decodescript(REDEEM_SCRIPT.hex())["p2sh"]
+        node.generatetoaddress(110, address)
+
+        self.log.info("Refuse the hash without -muhash")
+        assert_raises_rpc_error(-1, "restart with -muhash", self.nodes[1].gettxoutsetinfo, "muhash")
+
+        self.log.info("Follow blocks that spend coins being connected and disconnected")
+        hashes = {}
+        for height in range(1, 6):
+            hashes[node.getblockcount()] = self.muhash(node)
+            tx = CTransaction()
+            tx.vin.append(CTxIn(COutPoint(int(node.getblock(node.getblockhash(height))["tx"][0], 16), 0), CScript([REDEEM_SCRIPT])))
+            tx.vout = [CTxOut((50 * COIN - FEE) // 2, P2SH_SCRIPT)] * 2
+            node.sendrawtransaction(ToHex(tx))
+            node.generatetoaddress(1, address)
+        tip = self.muhash(node)
+        block = node.getblockhash(113)
+        node.invalidateblock(block)
+        assert_equal(self.muhash(node), hashes[112])
+        node.reconsiderblock(block)
+        assert_equal(self.muhash(node), tip)
+
+        self.log.info("Compute the hash on startup")
+        sync_blocks(self.nodes)
+        self.restart_node(1, ["-muhash"])
+        assert_equal(self.muhash(self.nodes[1]), tip)
+
+        self.log.info("Drop the hash while it isn't kept, and compute it again")
+        self.restart_node(0, [])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[0].generatetoaddress(5, address)
+        sync_blocks(self.nodes)
+        self.restart_node(0, ["-muhash"])
+        assert_equal(self.muhash(self.nodes[0]), self.muhash(self.nodes[1]))
+
+if __name__ == '__main__':
+    MuHashTest().main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumping the UTXO set with dumptxoutset and loading it with -loadtxoutset.
+
+- dumptxoutset doesn't leave a partial file behind when it fails.
+- node0 mines a chain and writes a snapshot of its UTXO set.
+- node1 refuses the snapshot with a wrong -assumeutxo hash, or with metadata
+  that doesn't match its coins and headers.
+- node1 loads the snapshot with the right hash, ends up with the same tip and
+  UTXO set, and follows node0 from there, also across a restart.
+- node1 reports the snapshot as not validated, and doesn't advertise
+  NODE_NETWORK for the blocks it doesn't have.
+"""
+import os
+import shutil
+import struct
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    connect_nodes,
+    sync_blocks,
+)
+
+NODE_NETWORK = 1
+NODE_NETWORK_LIMITED = 1 << 10
+
+class SnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-muhash"], ["-muhash"]]
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def assert_unvalidated_snapshot(self, node, height):
+        blockchaininfo = node.getblockchaininfo()
+        assert_equal(blockchaininfo["snapshotheight"], height)
+        assert_equal(blockchaininfo["snapshotvalidated"], False)
+        assert "UTXO set snapshot" in blockchaininfo["warnings"]
+        services = int(node.getnetworkinfo()["localservices"], 16)
+        assert_equal(services & NODE_NETWORK, 0)
+        assert_equal(services & NODE_NETWORK_LIMITED, NODE_NETWORK_LIMITED)
+
+    def run_test(self):
+        self.log.info("Remove the partial snapshot when dumptxoutset fails")
+        assert_raises_rpc_error(-1, "No blocks to take a snapshot at", self.nodes[0].dumptxoutset, "utxo.dat")
+        datadir = os.path.join(self.nodes[0].datadir, "regtest")
+        assert not os.path.exists(os.path.join(datadir, "utxo.dat"))
+        assert not os.path.exists(os.path.join(datadir, "utxo.dat.incomplete"))
+
+        address = self.nodes[0].decodescript("51")["p2sh"]
+        self.nodes[0].generatetoaddress(150, address)
+
+        self.log.info("Write a snapshot of the UTXO set")
+        snapshot = self.nodes[0].dumptxoutset("utxo.dat")
+        txoutsetinfo = self.nodes[0].gettxoutsetinfo()
+        assert_equal(snapshot["coins_written"], txoutsetinfo["txouts"])
+        assert_equal(snapshot["base_hash"], self.nodes[0].getbestblockhash())
+        assert_equal(snapshot["base_height"], 150)
+        assert_equal(snapshot["hash_serialized_2"], txoutsetinfo["hash_serialized_2"])
+        assert os.path.isfile(snapshot["path"])
+        assert_raises_rpc_error(-8, "already exists", self.nodes[0].dumptxoutset, "utxo.dat")
+
+        self.log.info("Refuse a snapshot that does not match the trusted hash")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, ["-loadtxoutset=%s" % snapshot["path"], "-assumeutxo=%s" % ("00" * 32)],
+                                            "Unable to load the UTXO set snapshot")
+
+        self.log.info("Refuse a snapshot with metadata that does not match its contents")
+        # The metadata starts with the magic bytes, the version, the base block
+        # hash, the transaction count, the coin count and the UTXO set hash.
+        for offset, value, reason in [(39, struct.pack("<Q", 1), "impossible transaction count 1"),
+                                      (55, bytes(32), "snapshot hash %s does not match" % ("00" * 32))]:
+            tampered = snapshot["path"] + ".tampered"
+            shutil.copyfile(snapshot["path"], tampered)
+            with open(tampered, "r+b") as f:
+                f.seek(offset)
+                f.write(value)
+            self.assert_start_raises_init_error(1, ["-reindex-chainstate", "-loadtxoutset=%s" % tampered, "-assumeutxo=%s" % snapshot["hash_serialized_2"]],
+                                                "Unable to load the UTXO set snapshot")
+            os.remove(tampered)
+            with open(os.path.join(self.nodes[1].datadir, "regtest", "debug.log"), encoding="utf-8") as f:
+                assert reason in f.read()
+
+        self.log.info("Load the snapshot")
+        self.start_node(1, ["-muhash", "-reindex-chainstate", "-loadtxoutset=%s" % snapshot["path"], "-assumeutxo=%s" % snapshot["hash_serialized_2"]])
+        assert_equal(self.nodes[1].getbestblockhash(), snapshot["base_hash"])
+        self.assert_unvalidated_snapshot(self.nodes[1], 150)
+        assert "snapshotheight" not in self.nodes[0].getblockchaininfo()
+        assert_equal(int(self.nodes[0].getnetworkinfo()["localservices"], 16) & NODE_NETWORK, NODE_NETWORK)
+        assert_equal(self.nodes[1].gettxoutsetinfo()["hash_serialized_2"], snapshot["hash_serialized_2"])
+        assert_equal(self.nodes[1].gettxoutsetinfo("muhash")["muhash"], self.nodes[0].gettxoutsetinfo("muhash")["muhash"])
+
+        self.log.info("Connect blocks on top of the snapshot")
+        connect_nodes(self.nodes[1], 0)
+        self.nodes[0].generatetoaddress(10, address)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].gettxoutsetinfo(), self.nodes[0].gettxoutsetinfo())
+        assert_equal(self.nodes[1].gettxoutsetinfo("muhash")["muhash"], self.nodes[0].gettxoutsetinfo("muhash")["muhash"])
+
+        self.log.info("Restart on the loaded chain state")
+        self.restart_node(1, ["-muhash", "-loadtxoutset=%s" % snapshot["path"], "-assumeutxo=%s" % snapshot["hash_serialized_2"]])
+        assert_equal(self.nodes[1].getblockcount(), 160)
+        self.assert_unvalidated_snapshot(self.nodes[1], 150)
+        connect_nodes(self.nodes[1], 0)
+        self.nodes[0].generatetoaddress(5, address)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[1].gettxoutsetinfo()["hash_serialized_2"], self.nodes[0].gettxoutsetinfo()["hash_serialized_2"])
+        assert_equal(self.nodes[1].gettxoutsetinfo("muhash")["muhash"], self.nodes[0].gettxoutsetinfo("muhash")["muhash"])
+
+if __name__ == '__main__':
+    SnapshotTest().main()
@@ -6,6 +6,7 @@
 
 - getmininginfo
 - getblocktemplate proposal mode
+- getblocktemplate stratum mode
 - submitblock"""
 
 import copy
@@ -13,9 +14,9 @@ from binascii import b2a_hex
 from decimal import Decimal
 
 from test_framework.blocktools import create_coinbase
-from test_framework.mininode import CBlock
+from test_framework.mininode import CBlock, CBlockHeader, hash256, ser_uint256, uint256_from_str
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import assert_equal, assert_raises_rpc_error
+from test_framework.util import assert_equal, assert_raises_rpc_error, hex_str_to_bytes
 
 def b2x(b):
     return b2a_hex(b).decode('ascii')
@@ -131,5 +132,53 @@ class MiningTest(BitcoinTestFramework):
         bad_block.hashPrevBlock = 123
         assert_template(node, bad_block, 'inconclusive-not-best-prevblk')
 
+        self.log.info("getblocktemplate: Test stratum mode")
+        node.sendtoaddress(node.getnewaddress(), 1)
+        tmpl = node.getblocktemplate({'mode': 'stratum'})
+        assert 'transactions' not in tmpl
+        assert_equal(tmpl['txcount'], 1)
+        assert_equal(node.getblocktemplate({'mode': 'stratum'})['workid'], tmpl['workid'])
+
+        coinbase_tx = create_coinbase(height=int(tmpl["height"]))
+        coinbase_tx.vout[0].nValue = tmpl["coinbasevalue"]
+        coinbase_tx.rehash()
+
+        block = CBlock()
+        block.nVersion = tmpl["version"]
+        block.hashPrevBlock = int(tmpl["previousblockhash"], 16)
+        block.nTime = tmpl["curtime"]
+        block.nBits = int(tmpl["bits"], 16)
+        block.nNonce = 0
+        merkle_root = ser_uint256(coinbase_tx.sha256)
+        for h in tmpl["merklebranch"]:
+            merkle_root = hash256(merkle_root + hex_str_to_bytes(h))
+        block.hashMerkleRoot = uint256_from_str(merkle_root)
+        block.solve()
+
+        self.log.info("submitblock: Test header and coinbase for stratum work")
+        header_and_coinbase = b2x(CBlockHeader(block).serialize() + coinbase_tx.serialize())
+        assert_equal(node.submitblock(header_and_coinbase, {'workid': '0'}), 'stale-work')
+        assert_equal(node.submitblock(header_and_coinbase, {'workid': tmpl['workid']}), None)
+        assert_equal(node.getbestblockhash(), block.hash)
+        assert_equal(node.getmempoolinfo()['size'], 0)
+
+        self.log.info("submitblock: Test stratum work on a replaced tip")
+        tmpl = node.getblocktemplate({'mode': 'stratum'})
+        coinbase_tx = create_coinbase(height=int(tmpl["height"]))
+        coinbase_tx.vout[0].nValue = tmpl["coinbasevalue"]
+        coinbase_tx.rehash()
+        block = CBlock()
+        block.nVersion = tmpl["version"]
+        block.hashPrevBlock = int(tmpl["previousblockhash"], 16)
+        block.nTime = tmpl["curtime"]
+        block.nBits = int(tmpl["bits"], 16)
+        block.nNonce = 0
+        block.hashMerkleRoot = coinbase_tx.sha256
+        block.solve()
+        node.generate(1)
+        header_and_coinbase = b2x(CBlockHeader(block).serialize() + coinbase_tx.serialize())
+        assert_equal(node.submitblock(header_and_coinbase, {'workid': tmpl['workid']}), 'stale-work')
+        assert_equal(node.getblocktemplate({'mode': 'stratum'})['previousblockhash'], node.getbestblockhash())
+
 if __name__ == '__main__':
     MiningTest().main()
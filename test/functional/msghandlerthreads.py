@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test relay through a node with several message handler threads.
+
+node1 and node2 are only connected through node0, which handles messages
+with four threads. Blocks and transactions sent by either side must reach
+the other one, in an order that keeps chains of transactions valid.
+"""
+
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes_bi, sync_blocks, sync_mempools
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+FEE = 10000
+
+def spend(txid, n, value):
+    """Spend output n of txid, paid to P2SH(OP_TRUE), to an output like it."""
+    tx = CTransaction()
+    tx.vin.append(CTxIn(COutPoint(int(txid, 16), n), CScript([REDEEM_SCRIPT])))
+    tx.vout.append(CTxOut(value, P2SH_SCRIPT))
+    tx.rehash()
+    return tx
+
+class MsgHandlerThreadsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.setup_clean_chain = True
+        self.extra_args = [["-msghandlerthreads=4"], [], []]
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes_bi(self.nodes, 0, 1)
+        connect_nodes_bi(self.nodes, 0, 2)
+
+    def run_test(self):
+        assert_equal(self.nodes[0].getnetworkinfo()["msghandlerthreads"], 4)
+        address = self.nodes[1].decodescript(REDEEM_SCRIPT.hex())["p2sh"]
+
+        self.log.info("Relay blocks from both sides")
+        self.nodes[1].generatetoaddress(60, address)
+        sync_blocks(self.nodes)
+        self.nodes[2].generatetoaddress(60, address)
+        sync_blocks(self.nodes)
+        coinbases = [self.nodes[1].getblock(self.nodes[1].getblockhash(height))["tx"][0] for height in range(1, 21)]
+
+        self.log.info("Relay transactions and chains of transactions from both sides")
+        for i, coinbase in enumerate(coinbases):
+            sender = self.nodes[1 + i % 2]
+            tx = spend(coinbase, 0, 50 * COIN - FEE)
+            sender.sendrawtransaction(ToHex(tx))
+            for _ in range(3):
+                tx = spend(tx.hash, 0, tx.vout[0].nValue - FEE)
+                sender.sendrawtransaction(ToHex(tx))
+        sync_mempools(self.nodes)
+        assert_equal(len(self.nodes[0].getrawmempool()), 4 * len(coinbases))
+
+        self.log.info("Mine the transactions")
+        self.nodes[2].generatetoaddress(1, address)
+        sync_blocks(self.nodes)
+        for node in self.nodes:
+            assert_equal(node.getrawmempool(), [])
+
+if __name__ == '__main__':
+    MsgHandlerThreadsTest().main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test serving blocks that are read from disk in the background.
+
+node0 reads blocks with four threads, node1 on the message handler thread.
+Both must answer a getdata for many old blocks, followed by a transaction they
+don't have, in the order it was asked for, while other peers download blocks
+at the same time.
+"""
+
+from test_framework.mininode import (
+    CInv,
+    P2PInterface,
+    mininode_lock,
+    msg_getdata,
+    network_thread_start,
+    wait_until,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, sync_blocks
+
+MSG_TX = 1
+MSG_BLOCK = 2
+
+class ResponseRecorder(P2PInterface):
+    """Records the blocks and notfound messages received, in order."""
+    def __init__(self):
+        super().__init__()
+        self.responses = []
+
+    def on_block(self, message):
+        message.block.calc_sha256()
+        self.responses.append(message.block.sha256)
+
+    def on_notfound(self, message):
+        self.responses.append("notfound")
+
+class BlockReadTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-blockreadthreads=4", "-blockcache=0"], ["-blockreadthreads=0", "-blockcache=0"]]
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes(self.nodes[1], 0)
+
+    def run_test(self):
+        self.nodes[0].generatetoaddress(200, self.nodes[0].decodescript("51")["p2sh"])
+        sync_blocks(self.nodes)
+        hashes = [int(self.nodes[0].getblockhash(height), 16) for height in range(1, 201)]
+
+        peers = [[node.add_p2p_connection(ResponseRecorder()) for _ in range(3)] for node in self.nodes]
+        network_thread_start()
+        for node_peers in peers:
+            for peer in node_peers:
+                peer.wait_for_verack()
+
+        for node, node_peers in zip(self.nodes, peers):
+            self.log.info("Serve getdata in order with -blockreadthreads=%d" % (4 if node is self.nodes[0] else 0))
+            expected = []
+            for i, peer in enumerate(node_peers):
+                # Each peer asks for a different range, so that the reads of
+                # the peers are interleaved.
+                blocks = hashes[i * 60:(i + 1) * 60]
+                # The transaction must only be answered after all the blocks.
+                invs = [CInv(MSG_BLOCK, h) for h in blocks] + [CInv(MSG_TX, 1)]
+                expected.append(blocks + ["notfound"])
+                peer.send_message(msg_getdata(invs))
+            for peer, peer_expected in zip(node_peers, expected):
+                wait_until(lambda: len(peer.responses) >= len(peer_expected), timeout=60, lock=mininode_lock)
+                with mininode_lock:
+                    assert_equal(peer.responses, peer_expected)
+                    peer.responses = []
+
+            # None of the peers was disconnected.
+            for peer in node_peers:
+                peer.sync_with_ping()
+
+if __name__ == '__main__':
+    BlockReadTest().main()
@@ -7,6 +7,9 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Repeat -reindex-chainstate with the block pipeline disabled and with a depth of 1, and verify
+  that the same UTXO set is built every time.
+- Repeat -reindex reading the block files on one thread and on several threads.
 """
 
 from test_framework.test_framework import BitcoinTestFramework
@@ -19,15 +22,16 @@ class ReindexTest(BitcoinTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 1
 
-    def reindex(self, justchainstate=False):
+    def reindex(self, justchainstate=False, extra_args=[]):
         self.nodes[0].generate(3)
         blockcount = self.nodes[0].getblockcount()
+        utxos = self.nodes[0].gettxoutsetinfo()
         self.stop_nodes()
-        extra_args = [["-reindex-chainstate" if justchainstate else "-reindex", "-checkblockindex=1"]]
-        self.start_nodes(extra_args)
+        self.start_nodes([["-reindex-chainstate" if justchainstate else "-reindex", "-checkblockindex=1"] + extra_args])
         while self.nodes[0].getblockcount() < blockcount:
             time.sleep(0.1)
         assert_equal(self.nodes[0].getblockcount(), blockcount)
+        assert_equal(self.nodes[0].gettxoutsetinfo()['hash_serialized_2'], utxos['hash_serialized_2'])
         self.log.info("Success")
 
     def run_test(self):
@@ -35,6 +39,10 @@ class ReindexTest(BitcoinTestFramework):
         self.reindex(True)
         self.reindex(False)
         self.reindex(True)
+        self.reindex(True, ["-pipelineblocks=0"])
+        self.reindex(True, ["-pipelineblocks=1"])
+        self.reindex(False, ["-reindexthreads=1"])
+        self.reindex(False, ["-reindexthreads=4"])
 
 if __name__ == '__main__':
     ReindexTest().main()
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) 2017 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the sendrawtransactions RPC.
+
+- A chain of transactions is accepted whatever the order it is sent in.
+- Each transaction gets its own result: missing inputs, duplicates and
+  confirmed transactions are reported per transaction.
+- Packages of more than 25 transactions or 101 kilobytes are refused.
+"""
+
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+FEE = 10000
+
+def spend(txid, n, value, outputs=1):
+    """Spend output n of txid, paid to P2SH(OP_TRUE), to outputs like it."""
+    tx = CTransaction()
+    tx.vin.append(CTxIn(COutPoint(int(txid, 16), n), CScript([REDEEM_SCRIPT])))
+    for _ in range(outputs):
+        tx.vout.append(CTxOut(value // outputs, P2SH_SCRIPT))
+    tx.rehash()
+    return tx
+
+class SendRawTransactionsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.decodescript(REDEEM_SCRIPT.hex())["p2sh"]
+        node.generatetoaddress(110, address)
+        coinbases = [node.getblock(node.getblockhash(height))["tx"][0] for height in range(1, 11)]
+
+        self.log.info("Accept a chain of transactions sent children first")
+        chain = [spend(coinbases[0], 0, 50 * COIN - FEE)]
+        for _ in range(2):
+            chain.append(spend(chain[-1].hash, 0, chain[-1].vout[0].nValue - FEE))
+        results = node.sendrawtransactions([ToHex(tx) for tx in reversed(chain)])
+        assert_equal([result["txid"] for result in results], [tx.hash for tx in reversed(chain)])
+        assert all("error" not in result for result in results)
+        assert_equal(sorted(node.getrawmempool()), sorted(tx.hash for tx in chain))
+
+        self.log.info("Report the result of each transaction")
+        orphan = spend("ff" * 32, 0, 50 * COIN - FEE)
+        results = node.sendrawtransactions([ToHex(chain[0]), ToHex(orphan)])
+        assert "error" not in results[0]
+        assert_equal(results[1]["error"], "Missing inputs")
+        node.generatetoaddress(1, address)
+        assert_equal(node.getrawmempool(), [])
+        results = node.sendrawtransactions([ToHex(chain[-1])])
+        assert_equal(results[0]["error"], "transaction already in block chain")
+
+        self.log.info("Refuse packages that are too large")
+        long_chain = [spend(coinbases[1], 0, 50 * COIN - FEE)]
+        for _ in range(25):
+            long_chain.append(spend(long_chain[-1].hash, 0, long_chain[-1].vout[0].nValue - FEE))
+        assert_raises_rpc_error(-8, "At most 25 transactions", node.sendrawtransactions, [ToHex(tx) for tx in long_chain])
+        wide = [spend(coinbases[2 + i], 0, 50 * COIN - FEE, outputs=1700) for i in range(2)]
+        assert_raises_rpc_error(-8, "at most 101 kilobytes", node.sendrawtransactions, [ToHex(tx) for tx in wide])
+        assert_equal(node.getrawmempool(), [])
+
+        results = node.sendrawtransactions([ToHex(tx) for tx in long_chain[:25]])
+        assert all("error" not in result for result in results)
+        assert_equal(len(node.getrawmempool()), 25)
+
+if __name__ == '__main__':
+    SendRawTransactionsTest().main()
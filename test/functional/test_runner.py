@@ -96,12 +96,14 @@ BASE_SCRIPTS= [
     'multi_rpc.py',
     'proxy_test.py',
     'signrawtransactions.py',
+    'sendrawtransactions.py',
     'disconnect_ban.py',
     'decodescript.py',
     'blockchain.py',
     'deprecated_rpc.py',
     'disablewallet.py',
     'net.py',
+    'msghandlerthreads.py',
     'keypool.py',
     'p2p-mempool.py',
     'prioritise_transaction.py',
@@ -125,9 +127,12 @@ BASE_SCRIPTS= [
     'resendwallettransactions.py',
     'minchainwork.py',
     'p2p-fingerprint.py',
+    'p2p-blockread.py',
     'uacomment.py',
     'p2p-acceptblock.py',
     'feature_logging.py',
+    'feature_snapshot.py',
+    'feature_muhash.py',
     'node_network_limited.py',
     'conf_args.py',
     # Don't append tests at the end to avoid merge conflicts